@@ -4,43 +4,6 @@ systemctl --user import-environment
 mkdir -p ~/.config
 cp -rf ~/.dwm/assets/* ~/.config/
 
-(
-while true; do
-feh --recursive --randomize --bg-fill ~/.wallpaper/*.png >> /dev/null 2>&1
-sleep 120;
-done &
-)
-
-(
-while true; do
-[[ $(pgrep -x 'picom') ]] || picom --config ~/.config/picom/picom.conf >> /dev/null 2>&1
-sleep 3;
-done &
-)
-
-# When any browser is focused on YouTube and in fullscreen mode, kill xautolock
-(
-while true; do
-	for browser in "firefox" "brave" "chrome" "chromium"; do
-		xdotool search --class "${browser}" | while read wm_id; do
-			if [[ 0 -ne $(xprop -id ${wm_id} | grep '_NET_WM_STATE_FULLSCREEN' | wc -l) ]]; then
-				if [[ 0 -ne $(xprop -id ${wm_id} | grep -E 'YouTube|小宝影院' | wc -l) ]]; then
-				[[ $(pgrep -x 'xautolock') ]] && killall xautolock
-			fi
-			fi
-		done
-	done
-sleep 5;
-done &
-)
-
-(
-while true; do
-	[[ $(pgrep -x 'xautolock') ]] || xautolock -detectsleep -time 5 -locker 'i3lock -c 0e0e0e -n' >> /dev/null 2>&1 &
-	sleep 300;
-done &
-)
-
 # wacom settings
 DEVICE1="Wacom Intuos BT M Pen stylus"
 DEVICE2="Wacom Intuos BT M Pad pad"
@@ -51,12 +14,6 @@ DEVICE2="Wacom Intuos BT M Pad pad"
 xsetwacom set "$DEVICE2" Button 3 "key F9"
 xsetwacom set "$DEVICE2" Button 8 "key Shift F9"
 
-blueman-applet &
-fcitx5 &
-flameshot &
-gromit-mpx &
-opensnitch-ui &
-goldendict &
 # tmux has-session && exec kitty tmux attach || exec kitty tmux &
 tmux has-session && exec alacritty -e tmux attach || exec alacritty -e tmux &
 # exec setxkbmap us dvorak & 
@@ -1,5 +1,5 @@
 /* See LICENSE file for copyright and license details. */
-#define SESSION_FILE "/tmp/dwm-session"
+#define SESSION_FILE "dwm-session" /* in $XDG_RUNTIME_DIR or $XDG_STATE_HOME */
 #define ICONSIZE 16   /* icon size */
 #define ICONSPACING 8 /* space between icon and title */
 
@@ -82,6 +82,21 @@ static const unsigned int alphas[][3] = {
 /* Select the font index for you statusbar
  * the index is zero based*/
 static const int statusfontindex = 2;
+
+/* built-in status, 0 reads the status text from the root window name */
+static const int builtinstatus = 0;
+static const char statussep[] = "  ";
+/* 1 means external producers may publish status segments through shared
+ * memory, see dwm-setstatus(1) */
+static const int shmstatus = 1;
+static const StatusModule statusmodules[] = {
+    /* function        format      argument          interval (ms) */
+    { status_netrx,    "󰇚 %s",     "wlan0",          2000 },
+    { status_cpu,      " %s",     NULL,             2000 },
+    { status_mem,      " %s",     NULL,             5000 },
+    { status_battery,  "󰁹 %s",     "BAT0",           30000 },
+    { status_clock,    "%s",       "%a %d %b %H:%M", 1000 },
+};
 /* tagging */
 static const char *tags[] = { "", "󰰶", "󰰡", "󰰛", "󰰰", "󰰰", "󰰭", "󰰘", "󰎣" };
 
@@ -169,12 +184,43 @@ static const Layout layouts[] = {
 /* commands */
 static const char *menucmd[] = { "/bin/sh", "-c" , "~/.dwm/scripts/rofi/powermenu.sh" , NULL };
 static const char *roficmd[] = { "/bin/sh", "-c" , "~/.dwm/scripts/rofi/launcher.sh" , NULL };
-static const char *scrkcmd[] = { "/bin/sh", "-c" , "~/.dwm/scripts/screenkey/screenkey.sh" , NULL };
-static const char *kmagcmd[] = { "/bin/sh", "-c" , "~/.dwm/scripts/kmagnifier/kmagnifier.sh" , NULL };
 static const char *rangcmd[] = { "kitty", "ranger", NULL };
 static const char *flamcmd[] = { "flameshot", "gui", NULL };
 static const char *thuncmd[] = { "thunar", NULL };
 static const char *termcmd[] = { "alacritty", NULL };
+static const char *scrkcmd[] = { "screenkey", NULL };
+static const char *kmagcmd[] = { "kmag", NULL };
+
+/* locker started after locktime seconds without input, 0 disables it;
+ * it is held off while the focused window is fullscreen */
+static const unsigned int locktime = 300;
+static const char *lockcmd[] = { "i3lock", "-c", "0e0e0e", "-n", NULL };
+
+/* a random image below wallpaperdir is shown on each monitor, changing
+ * every wallinterval seconds, 0 disables it */
+static const char wallpaperdir[] = "~/.wallpaper";
+static const unsigned int wallinterval = 120;
+
+/* the first press starts the command, the next ones act on its window,
+ * found by class, or on the process started */
+static const Toggle toggles[] = {
+    /* class        command     action */
+    { "screenkey",  scrkcmd,    ToggleKill },
+    { "kmag",       kmagcmd,    ToggleKill },
+};
+
+/* started along with dwm, each restarted whenever it exits, after a delay
+ * that grows while it keeps exiting right away */
+static const Service services[] = {
+    /* name             command */
+    { "picom",          (const char *[]){ "/bin/sh", "-c", "exec picom --config ~/.config/picom/picom.conf", NULL } },
+    { "blueman-applet", (const char *[]){ "blueman-applet", NULL } },
+    { "fcitx5",         (const char *[]){ "fcitx5", NULL } },
+    { "flameshot",      (const char *[]){ "flameshot", NULL } },
+    { "gromit-mpx",     (const char *[]){ "gromit-mpx", NULL } },
+    { "opensnitch-ui",  (const char *[]){ "opensnitch-ui", NULL } },
+    { "goldendict",     (const char *[]){ "goldendict", NULL } },
+};
 
 static const Key keys[] = {
     /* modifier                     key            function            argument */
@@ -183,8 +229,8 @@ static const Key keys[] = {
     { MODKEY,                       XK_e,          spawn,              {.v = rangcmd } },
     { MODKEY|ShiftMask,             XK_e,          spawn,              {.v = thuncmd } },
     { MODKEY,                       XK_s,          spawn,              {.v = flamcmd } },
-    { MODKEY|ShiftMask,             XK_s,          spawn,              {.v = scrkcmd } },
-    { MODKEY|ShiftMask,             XK_z,          spawn,              {.v = kmagcmd } },
+    { MODKEY|ShiftMask,             XK_s,          runortoggle,        {.v = &toggles[0] } },
+    { MODKEY|ShiftMask,             XK_z,          runortoggle,        {.v = &toggles[1] } },
     { MODKEY|ShiftMask,             XK_Return,     spawn,              {.v = termcmd } },
     { MODKEY,                       XK_b,          togglebar,          {0} },
     { MODKEY|ShiftMask,             XK_h,          rotatestack,        {.i = +1 } },
@@ -237,6 +283,40 @@ static const Key keys[] = {
     TAGKEYS(                        XK_8,                               7)
     TAGKEYS(                        XK_9,                               8)
     { MODKEY|ShiftMask,             XK_q,          quit,               {0} },
+    { MODKEY|ControlMask|ShiftMask, XK_q,          restart,            {0} },
+};
+
+/* commands started ahead of time whose windows stay unmanaged and unmapped
+ * until used, so that their spawn key shows a window at once; the pool
+ * grows up to max while used often */
+static const Warm warmcmds[] = {
+    /* command      max */
+    { termcmd,      3 },
+};
+
+/* commands accepted on the IPC socket, see dwm-msg(1) */
+static const IpcCommand ipccommands[] = {
+    /* name             function            argument */
+    { "view",           view,               IpcArgUint },
+    { "toggleview",     toggleview,         IpcArgUint },
+    { "tag",            tag,                IpcArgUint },
+    { "toggletag",      toggletag,          IpcArgUint },
+    { "cycleview",      cycleview,          IpcArgUint },
+    { "setlayout",      setlayout,          IpcArgLayout },
+    { "cyclelayout",    cyclelayout,        IpcArgInt },
+    { "setmfact",       setmfact,           IpcArgMfact },
+    { "incnmaster",     incnmaster,         IpcArgInt },
+    { "setgaps",        setgaps,            IpcArgInt },
+    { "focusstack",     focusstackvis,      IpcArgInt },
+    { "movestack",      movestack,          IpcArgInt },
+    { "rotatestack",    rotatestack,        IpcArgInt },
+    { "focusmon",       focusmon,           IpcArgInt },
+    { "tagmon",         tagmon,             IpcArgInt },
+    { "zoom",           zoom,               IpcArgNone },
+    { "killclient",     killclient,         IpcArgNone },
+    { "togglefloating", togglefloating,     IpcArgNone },
+    { "togglebar",      togglebar,          IpcArgNone },
+    { "restart",        restart,            IpcArgNone },
 };
 
 /* button definitions */
@@ -14,6 +14,11 @@ X11LIB = /usr/lib
 XINERAMALIBS  = -lXinerama
 XINERAMAFLAGS = -DXINERAMA
 
+# XRandR 1.5 monitors, preferred to Xinerama when the server has them,
+# comment if you don't want it
+XRANDRLIBS  = -lXrandr
+XRANDRFLAGS = -DXRANDR
+
 # freetype
 FREETYPELIBS = -lfontconfig -lXft
 FREETYPEINC = /usr/include/freetype2
@@ -28,10 +33,10 @@ FREETYPEINC = /usr/include/freetype2
 
 # includes and libs
 INCS = -I${X11INC} -I${FREETYPEINC}
-LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${FREETYPELIBS} -lXrender -lm -lImlib2
+LIBS = -L${X11LIB} -lX11 -lXext ${XINERAMALIBS} ${XRANDRLIBS} ${FREETYPELIBS} -lXrender -lm -lImlib2 -lpthread
 
 # flags
-CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS}
+CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS} ${XRANDRFLAGS}
 CFLAGS   = -g -std=c99 -pedantic -Wall -Wno-deprecated-declarations -Os ${INCS} ${CPPFLAGS}
 LDFLAGS  = ${LIBS}
 
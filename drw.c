@@ -1,16 +1,32 @@
 /* See LICENSE file for copyright and license details. */
-#include <Imlib2.h>
 #include <X11/Xft/Xft.h>
 #include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include "drw.h"
 #include "util.h"
 
 #define UTF_INVALID 0xFFFD
 #define UTF_SIZ 4
+#define ATLAS_COLS 16
+#define ATLAS_SLOTS 16 /* shm staging slots between syncs */
+
+struct DrwAtlas {
+    Pixmap pixmap;
+    Picture picture;
+    GC gc;
+    unsigned int cellw, cellh, cells;
+    unsigned char *used;
+    int shm; /* staging segment attached by the server */
+    XShmSegmentInfo seg;
+    unsigned int slot; /* next staging slot, the server is synced on wrap */
+};
 
 static const unsigned char utfbyte[UTF_SIZ + 1] = { 0x80, 0, 0xC0, 0xE0, 0xF0 };
 static const unsigned char utfmask[UTF_SIZ + 1] = { 0xC0, 0x80, 0xE0, 0xF0, 0xF8 };
@@ -75,8 +91,8 @@ drw_create(Display *dpy, int screen, Window root, unsigned int w,
     drw->visual = visual;
     drw->depth = depth;
     drw->cmap = cmap;
-    drw->drawable = XCreatePixmap(dpy, root, w, h, depth);
-    drw->picture = XRenderCreatePicture(
+    drw->drawable = drw->pixmap = XCreatePixmap(dpy, root, w, h, depth);
+    drw->picture = drw->pixpicture = XRenderCreatePicture(
         dpy, drw->drawable,
         XRenderFindVisualFormat(dpy, DefaultVisual(dpy, screen)), 0, NULL);
     drw->gc = XCreateGC(dpy, drw->drawable, 0, NULL);
@@ -88,32 +104,232 @@ drw_create(Display *dpy, int screen, Window root, unsigned int w,
 void
 drw_resize(Drw *drw, unsigned int w, unsigned int h)
 {
+    int own;
+
     if(!drw)
         return;
 
+    own = drw->drawable == drw->pixmap;
     drw->w = w;
     drw->h = h;
-    if(drw->picture)
-        XRenderFreePicture(drw->dpy, drw->picture);
-    if(drw->drawable)
-        XFreePixmap(drw->dpy, drw->drawable);
-    drw->drawable = XCreatePixmap(drw->dpy, drw->root, w, h, drw->depth);
-    drw->picture = XRenderCreatePicture(
-        drw->dpy, drw->drawable,
+    if(drw->pixpicture)
+        XRenderFreePicture(drw->dpy, drw->pixpicture);
+    if(drw->pixmap)
+        XFreePixmap(drw->dpy, drw->pixmap);
+    drw->pixmap = XCreatePixmap(drw->dpy, drw->root, w, h, drw->depth);
+    drw->pixpicture = XRenderCreatePicture(
+        drw->dpy, drw->pixmap,
         XRenderFindVisualFormat(drw->dpy, DefaultVisual(drw->dpy, drw->screen)),
         0, NULL);
+    if(own)
+        drw_setbuf(drw, NULL);
 }
 
 void
 drw_free(Drw *drw)
 {
-    XRenderFreePicture(drw->dpy, drw->picture);
-    XFreePixmap(drw->dpy, drw->drawable);
+    DrwAtlas *a = drw->atlas;
+
+    if(a) {
+        if(a->shm) {
+            XShmDetach(drw->dpy, &a->seg);
+            shmdt(a->seg.shmaddr);
+        }
+        XRenderFreePicture(drw->dpy, a->picture);
+        XFreePixmap(drw->dpy, a->pixmap);
+        XFreeGC(drw->dpy, a->gc);
+        free(a->used);
+        free(a);
+    }
+    XRenderFreePicture(drw->dpy, drw->pixpicture);
+    XFreePixmap(drw->dpy, drw->pixmap);
     XFreeGC(drw->dpy, drw->gc);
     drw_fontset_free(drw->fonts);
     free(drw);
 }
 
+static int shmfailed;
+
+static int
+shmerror(Display *dpy, XErrorEvent *ee)
+{
+    shmfailed = 1;
+    return 0;
+}
+
+/* Attach a staging segment the server reads uploads from. Remote servers
+ * cannot attach it, which is only reported asynchronously. */
+static int
+atlas_shm(Drw *drw, DrwAtlas *a, size_t size)
+{
+    int (*xerror)(Display *, XErrorEvent *);
+
+    if(!XShmQueryExtension(drw->dpy))
+        return 0;
+    if((a->seg.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600)) < 0)
+        return 0;
+    a->seg.shmaddr = shmat(a->seg.shmid, NULL, 0);
+    /* gone once both sides detach, even if we crash */
+    shmctl(a->seg.shmid, IPC_RMID, NULL);
+    if(a->seg.shmaddr == (char *)-1)
+        return 0;
+    a->seg.readOnly = True;
+    shmfailed = 0;
+    XSync(drw->dpy, False);
+    xerror = XSetErrorHandler(shmerror);
+    XShmAttach(drw->dpy, &a->seg);
+    XSync(drw->dpy, False);
+    XSetErrorHandler(xerror);
+    if(shmfailed) {
+        shmdt(a->seg.shmaddr);
+        return 0;
+    }
+    return 1;
+}
+
+void
+drw_atlas_init(Drw *drw, unsigned int cellw, unsigned int cellh,
+               unsigned int cells)
+{
+    DrwAtlas *a;
+
+    if(!drw || drw->atlas)
+        return;
+    cells = (cells + ATLAS_COLS - 1) / ATLAS_COLS * ATLAS_COLS;
+    a = ecalloc(1, sizeof(DrwAtlas));
+    a->cellw = cellw;
+    a->cellh = cellh;
+    a->cells = cells;
+    a->used = ecalloc(cells, 1);
+    a->pixmap = XCreatePixmap(drw->dpy, drw->root, ATLAS_COLS * cellw,
+                              cells / ATLAS_COLS * cellh, 32);
+    a->picture = XRenderCreatePicture(
+        drw->dpy, a->pixmap,
+        XRenderFindStandardFormat(drw->dpy, PictStandardARGB32), 0, NULL);
+    a->gc = XCreateGC(drw->dpy, a->pixmap, 0, NULL);
+    a->shm = atlas_shm(drw, a, (size_t)ATLAS_SLOTS * cellw * cellh * 4);
+    drw->atlas = a;
+}
+
+/* Put w x h pixels at x, y of drawable d, through the staging segment if
+ * there is one. */
+static void
+atlas_put(Drw *drw, DrwAtlas *a, Drawable d, int x, int y,
+          const uint32_t *px, unsigned int w, unsigned int h)
+{
+    XImage img = { w, h, 0, ZPixmap, (char *)px,
+                   ImageByteOrder(drw->dpy), BitmapUnit(drw->dpy),
+                   BitmapBitOrder(drw->dpy), 32, 32, 0, 32, 0, 0, 0 };
+
+    if(a->shm && w <= a->cellw && h <= a->cellh) {
+        if(a->slot == ATLAS_SLOTS) {
+            /* the server is done reading every slot once it answers */
+            XSync(drw->dpy, False);
+            a->slot = 0;
+        }
+        img.data = a->seg.shmaddr + (size_t)a->slot++ * a->cellw * a->cellh * 4;
+        memcpy(img.data, px, (size_t)w * h * 4);
+        img.obdata = (char *)&a->seg;
+        XInitImage(&img);
+        XShmPutImage(drw->dpy, d, a->gc, &img, 0, 0, x, y, w, h, False);
+        return;
+    }
+    XInitImage(&img);
+    XPutImage(drw->dpy, d, a->gc, &img, 0, 0, x, y, w, h);
+}
+
+int
+drw_image_create(Drw *drw, DrwImage *img, const uint32_t *px, unsigned int w,
+                 unsigned int h)
+{
+    DrwAtlas *a;
+    unsigned int i = 0;
+    Pixmap pm;
+
+    if(!drw || !(a = drw->atlas) || !w || !h)
+        return 0;
+    img->w = w;
+    img->h = h;
+    if(w <= a->cellw && h <= a->cellh)
+        for(i = 0; i < a->cells && a->used[i]; i++)
+            ;
+    if(w <= a->cellw && h <= a->cellh && i < a->cells) {
+        a->used[i] = 1;
+        img->picture = a->picture;
+        img->x = i % ATLAS_COLS * a->cellw;
+        img->y = i / ATLAS_COLS * a->cellh;
+        atlas_put(drw, a, a->pixmap, img->x, img->y, px, w, h);
+        return 1;
+    }
+    /* does not fit: an image of its own */
+    pm = XCreatePixmap(drw->dpy, drw->root, w, h, 32);
+    atlas_put(drw, a, pm, 0, 0, px, w, h);
+    img->picture = XRenderCreatePicture(
+        drw->dpy, pm, XRenderFindStandardFormat(drw->dpy, PictStandardARGB32),
+        0, NULL);
+    XFreePixmap(drw->dpy, pm);
+    img->x = img->y = 0;
+    return 1;
+}
+
+void
+drw_image_free(Drw *drw, DrwImage *img)
+{
+    DrwAtlas *a;
+
+    if(!drw || !(a = drw->atlas) || !img->picture)
+        return;
+    if(img->picture == a->picture)
+        a->used[img->y / a->cellh * ATLAS_COLS + img->x / a->cellw] = 0;
+    else
+        XRenderFreePicture(drw->dpy, img->picture);
+    img->picture = None;
+}
+
+DrwBuf *
+drw_buf_create(Drw *drw, unsigned int w, unsigned int h)
+{
+    DrwBuf *buf;
+
+    if(!drw || !w || !h)
+        return NULL;
+
+    buf = ecalloc(1, sizeof(DrwBuf));
+    buf->w = w;
+    buf->h = h;
+    buf->drawable = XCreatePixmap(drw->dpy, drw->root, w, h, drw->depth);
+    buf->picture
+        = XRenderCreatePicture(drw->dpy, buf->drawable,
+                               XRenderFindVisualFormat(drw->dpy, drw->visual),
+                               0, NULL);
+    return buf;
+}
+
+void
+drw_buf_free(Drw *drw, DrwBuf *buf)
+{
+    if(!drw || !buf)
+        return;
+
+    if(drw->drawable == buf->drawable)
+        drw_setbuf(drw, NULL);
+    XRenderFreePicture(drw->dpy, buf->picture);
+    XFreePixmap(drw->dpy, buf->drawable);
+    free(buf);
+}
+
+/* Redirect all drawing functions to buf, or back to drw's own pixmap if buf
+ * is NULL. */
+void
+drw_setbuf(Drw *drw, DrwBuf *buf)
+{
+    if(!drw)
+        return;
+
+    drw->drawable = buf ? buf->drawable : drw->pixmap;
+    drw->picture = buf ? buf->picture : drw->pixpicture;
+}
+
 /* This function is an implementation detail. Library users should use
  * drw_fontset_create instead.
  */
@@ -164,26 +380,115 @@ xfont_free(Fnt *font)
 {
     if(!font)
         return;
+    if(font->cover)
+        FcCharSetDestroy(font->cover);
     if(font->pattern)
         FcPatternDestroy(font->pattern);
-    XftFontClose(font->dpy, font->xfont);
+    if(font->xfont)
+        XftFontClose(font->dpy, font->xfont);
     free(font);
 }
 
+/* The codepoints the file fontname resolves to covers, as found in the
+ * fontconfig cache. Kept per file, so every fontset and every size of a
+ * face share one. */
+static FcCharSet *
+xfont_cover(Drw *drw, const char *fontname)
+{
+    static struct FileCover {
+        char *file;
+        FcCharSet *cover;
+    } *files;
+    static size_t nfiles;
+    struct FileCover *tmp = NULL;
+    FcPattern *pattern, *match;
+    FcCharSet *cover = NULL;
+    FcChar8 *file;
+    FcResult result;
+    size_t i;
+
+    if(!(pattern = FcNameParse((FcChar8 *)fontname)))
+        return NULL;
+    FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+    XftDefaultSubstitute(drw->dpy, drw->screen, pattern);
+    match = FcFontMatch(NULL, pattern, &result);
+    FcPatternDestroy(pattern);
+    if(!match)
+        return NULL;
+    if(FcPatternGetString(match, FC_FILE, 0, &file) != FcResultMatch)
+        file = NULL;
+    for(i = 0; file && i < nfiles; i++)
+        if(!strcmp(files[i].file, (char *)file)) {
+            cover = FcCharSetCopy(files[i].cover);
+            break;
+        }
+    if(!cover
+       && FcPatternGetCharSet(match, FC_CHARSET, 0, &cover) == FcResultMatch) {
+        cover = FcCharSetCopy(cover);
+        if(file && (tmp = realloc(files, (nfiles + 1) * sizeof(*files)))
+           && (tmp[nfiles].file = strdup((char *)file))) {
+            tmp[nfiles].cover = FcCharSetCopy(cover);
+            nfiles++;
+        }
+        if(tmp)
+            files = tmp;
+    }
+    FcPatternDestroy(match);
+    return cover;
+}
+
+/* Open a font drw_fontset_create deferred, once a codepoint it covers is
+ * looked up. Returns 0 if it does not cover codepoint or cannot be opened. */
+static int
+xfont_load(Drw *drw, Fnt *font, long codepoint)
+{
+    Fnt *f;
+
+    if(font->xfont)
+        return 1;
+    if(!font->name)
+        return 0;
+    if(!font->cover && !(font->cover = xfont_cover(drw, font->name))) {
+        font->name = NULL;
+        return 0;
+    }
+    if(!FcCharSetHasChar(font->cover, codepoint))
+        return 0;
+    if(!(f = xfont_create(drw, font->name, NULL))) {
+        font->name = NULL;
+        return 0;
+    }
+    FcCharSetDestroy(font->cover);
+    font->cover = NULL;
+    font->xfont = f->xfont;
+    font->pattern = f->pattern;
+    font->h = f->h;
+    free(f);
+    return 1;
+}
+
+/* Only the first font that loads is opened right away, the ones after it
+ * are opened when a glyph they cover is first looked up. */
 Fnt *
 drw_fontset_create(Drw *drw, const char *fonts[], size_t fontcount)
 {
-    Fnt *cur, *ret = NULL;
+    Fnt *cur, *ret = NULL, **tail = &ret;
     size_t i;
 
     if(!drw || !fonts)
         return NULL;
 
-    for(i = 1; i <= fontcount; i++) {
-        if((cur = xfont_create(drw, fonts[fontcount - i], NULL))) {
-            cur->next = ret;
-            ret = cur;
+    for(i = 0; i < fontcount; i++) {
+        if(!ret) {
+            if(!(cur = xfont_create(drw, fonts[i], NULL)))
+                continue;
+        } else {
+            cur = ecalloc(1, sizeof(Fnt));
+            cur->dpy = drw->dpy;
+            cur->name = fonts[i];
         }
+        *tail = cur;
+        tail = &cur->next;
     }
     return (drw->fonts = ret);
 }
@@ -240,102 +545,6 @@ drw_setscheme(Drw *drw, Clr *scm)
         drw->scheme = scm;
 }
 
-Picture
-drw_picture_create_resized(Drw *drw, char *src, unsigned int srcw,
-                           unsigned int srch, unsigned int dstw,
-                           unsigned int dsth)
-{
-    Pixmap pm;
-    Picture pic;
-    GC gc;
-
-    if(srcw <= (dstw << 1u) && srch <= (dsth << 1u)) {
-        XImage img = { srcw,
-                       srch,
-                       0,
-                       ZPixmap,
-                       src,
-                       ImageByteOrder(drw->dpy),
-                       BitmapUnit(drw->dpy),
-                       BitmapBitOrder(drw->dpy),
-                       32,
-                       32,
-                       0,
-                       32,
-                       0,
-                       0,
-                       0 };
-        XInitImage(&img);
-
-        pm = XCreatePixmap(drw->dpy, drw->root, srcw, srch, 32);
-        gc = XCreateGC(drw->dpy, pm, 0, NULL);
-        XPutImage(drw->dpy, pm, gc, &img, 0, 0, 0, 0, srcw, srch);
-        XFreeGC(drw->dpy, gc);
-
-        pic = XRenderCreatePicture(
-            drw->dpy, pm,
-            XRenderFindStandardFormat(drw->dpy, PictStandardARGB32), 0, NULL);
-        XFreePixmap(drw->dpy, pm);
-
-        XRenderSetPictureFilter(drw->dpy, pic, FilterBilinear, NULL, 0);
-        XTransform xf;
-        xf.matrix[0][0] = (srcw << 16u) / dstw;
-        xf.matrix[0][1] = 0;
-        xf.matrix[0][2] = 0;
-        xf.matrix[1][0] = 0;
-        xf.matrix[1][1] = (srch << 16u) / dsth;
-        xf.matrix[1][2] = 0;
-        xf.matrix[2][0] = 0;
-        xf.matrix[2][1] = 0;
-        xf.matrix[2][2] = 65536;
-        XRenderSetPictureTransform(drw->dpy, pic, &xf);
-    } else {
-        Imlib_Image origin
-            = imlib_create_image_using_data(srcw, srch, (DATA32 *)src);
-        if(!origin)
-            return None;
-        imlib_context_set_image(origin);
-        imlib_image_set_has_alpha(1);
-        Imlib_Image scaled
-            = imlib_create_cropped_scaled_image(0, 0, srcw, srch, dstw, dsth);
-        imlib_free_image_and_decache();
-        if(!scaled)
-            return None;
-        imlib_context_set_image(scaled);
-        imlib_image_set_has_alpha(1);
-
-        XImage img = { dstw,
-                       dsth,
-                       0,
-                       ZPixmap,
-                       (char *)imlib_image_get_data_for_reading_only(),
-                       ImageByteOrder(drw->dpy),
-                       BitmapUnit(drw->dpy),
-                       BitmapBitOrder(drw->dpy),
-                       32,
-                       32,
-                       0,
-                       32,
-                       0,
-                       0,
-                       0 };
-        XInitImage(&img);
-
-        pm = XCreatePixmap(drw->dpy, drw->root, dstw, dsth, 32);
-        gc = XCreateGC(drw->dpy, pm, 0, NULL);
-        XPutImage(drw->dpy, pm, gc, &img, 0, 0, 0, 0, dstw, dsth);
-        imlib_free_image_and_decache();
-        XFreeGC(drw->dpy, gc);
-
-        pic = XRenderCreatePicture(
-            drw->dpy, pm,
-            XRenderFindStandardFormat(drw->dpy, PictStandardARGB32), 0, NULL);
-        XFreePixmap(drw->dpy, pm);
-    }
-
-    return pic;
-}
-
 void
 drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled,
          int invert)
@@ -403,6 +612,8 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h,
             for(int i = 0; i < statusfontindex; i++)
                 curfont = curfont->next;
             for(; curfont; curfont = curfont->next) {
+                if(!xfont_load(drw, curfont, utf8codepoint))
+                    continue;
                 charexists
                     = charexists
                       || XftCharExists(drw->dpy, curfont->xfont, utf8codepoint);
@@ -525,6 +736,15 @@ drw_pic(Drw *drw, int x, int y, unsigned int w, unsigned int h, Picture pic)
                      x, y, w, h);
 }
 
+void
+drw_image(Drw *drw, int x, int y, const DrwImage *img)
+{
+    if(!drw || !img->picture)
+        return;
+    XRenderComposite(drw->dpy, PictOpOver, img->picture, None, drw->picture,
+                     img->x, img->y, 0, 0, x, y, img->w, img->h);
+}
+
 void
 drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h)
 {
@@ -7,7 +7,9 @@ typedef struct {
 typedef struct Fnt {
 	Display *dpy;
 	unsigned int h;
-	XftFont *xfont;
+	XftFont *xfont;    /* NULL until first used */
+	const char *name;  /* to load it from then, NULL if that failed */
+	FcCharSet *cover;  /* codepoints it has, while not loaded yet */
 	FcPattern *pattern;
 	struct Fnt *next;
 } Fnt;
@@ -15,6 +17,21 @@ typedef struct Fnt {
 enum { ColFg, ColBg, ColBorder }; /* Clr scheme index */
 typedef XftColor Clr;
 
+typedef struct {
+	unsigned int w, h;
+	Drawable drawable;
+	Picture picture;
+} DrwBuf;
+
+/* a small premultiplied ARGB32 image, normally a cell of the atlas */
+typedef struct {
+	Picture picture; /* the atlas, or the image's own when the atlas is full */
+	int x, y;        /* origin within picture */
+	unsigned int w, h;
+} DrwImage;
+
+typedef struct DrwAtlas DrwAtlas;
+
 typedef struct {
 	unsigned int w, h;
 	Display *dpy;
@@ -23,11 +40,14 @@ typedef struct {
 	Visual *visual;
 	unsigned int depth;
 	Colormap cmap;
-	Drawable drawable;
+	Drawable drawable; /* current drawing target */
 	Picture picture;
+	Drawable pixmap;   /* own pixmap, target when no buffer is set */
+	Picture pixpicture;
 	GC gc;
 	Clr *scheme;
 	Fnt *fonts;
+	DrwAtlas *atlas;
 } Drw;
 
 /* Drawable abstraction */
@@ -35,6 +55,16 @@ Drw *drw_create(Display *dpy, int screen, Window win, unsigned int w, unsigned i
 void drw_resize(Drw *drw, unsigned int w, unsigned int h);
 void drw_free(Drw *drw);
 
+/* Backing buffers */
+DrwBuf *drw_buf_create(Drw *drw, unsigned int w, unsigned int h);
+void drw_buf_free(Drw *drw, DrwBuf *buf);
+void drw_setbuf(Drw *drw, DrwBuf *buf);
+
+/* Image atlas, uploaded through MIT-SHM when the server is local */
+void drw_atlas_init(Drw *drw, unsigned int cellw, unsigned int cellh, unsigned int cells);
+int drw_image_create(Drw *drw, DrwImage *img, const uint32_t *px, unsigned int w, unsigned int h);
+void drw_image_free(Drw *drw, DrwImage *img);
+
 /* Fnt abstraction */
 Fnt *drw_fontset_create(Drw* drw, const char *fonts[], size_t fontcount);
 void drw_fontset_free(Fnt* set);
@@ -54,12 +84,11 @@ void drw_cur_free(Drw *drw, Cur *cursor);
 void drw_setfontset(Drw *drw, Fnt *set);
 void drw_setscheme(Drw *drw, Clr *scm);
 
-Picture drw_picture_create_resized(Drw *drw, char *src, unsigned int src_w, unsigned int src_h, unsigned int dst_w, unsigned int dst_h);
-
 /* Drawing functions */
 void drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int invert);
 int drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert, int statusfontindex);
 void drw_pic(Drw *drw, int x, int y, unsigned int w, unsigned int h, Picture pic);
+void drw_image(Drw *drw, int x, int y, const DrwImage *img);
 
 /* Map functions */
 void drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h);
@@ -0,0 +1,92 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Talk to a running dwm over its IPC socket:
+ *
+ *     dwm-msg run view 4          (show the third tag)
+ *     dwm-msg run setmfact 0.6
+ *     dwm-msg get clients
+ *     dwm-msg send '{"query":"tags"}'
+ *     dwm-msg send '{"batch":[{"command":"view","arg":2},
+ *                             {"command":"setmfact","arg":0.6}]}'
+ *     dwm-msg subscribe focus title
+ *
+ * The reply is printed as JSON; the exit status is 1 if dwm refused.
+ * subscribe keeps printing one event per line until dwm goes away.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ipc.h"
+#include "util.h"
+
+static void
+usage(void)
+{
+    die("usage: dwm-msg run command [number]\n"
+        "       dwm-msg get monitors|tags|clients|rules|services\n"
+        "       dwm-msg send json\n"
+        "       dwm-msg subscribe event...");
+}
+
+int
+main(int argc, char *argv[])
+{
+    IpcBuf req = { 0 };
+    char path[108], *reply, *end;
+    size_t len;
+    int fd = -1, i, sub = 0;
+
+    if(argc < 3)
+        usage();
+    if(!strcmp(argv[1], "run") && argc <= 4) {
+        ipc_buf_printf(&req, "{\"command\":");
+        ipc_buf_str(&req, argv[2]);
+        if(argc == 4) {
+            strtod(argv[3], &end);
+            if(!*argv[3] || *end)
+                die("dwm-msg: argument must be a number");
+            ipc_buf_printf(&req, ",\"arg\":%s", argv[3]);
+        }
+        ipc_buf_printf(&req, "}");
+    } else if(!strcmp(argv[1], "get") && argc == 3) {
+        ipc_buf_printf(&req, "{\"query\":");
+        ipc_buf_str(&req, argv[2]);
+        ipc_buf_printf(&req, "}");
+    } else if(!strcmp(argv[1], "send") && argc == 3)
+        ipc_buf_printf(&req, "%s", argv[2]);
+    else if(!strcmp(argv[1], "subscribe")) {
+        ipc_buf_printf(&req, "{\"subscribe\":[");
+        for(i = 2; i < argc; i++) {
+            ipc_buf_printf(&req, i > 2 ? "," : "");
+            ipc_buf_str(&req, argv[i]);
+        }
+        ipc_buf_printf(&req, "]}");
+        sub = 1;
+    } else
+        usage();
+
+    /* dwm tells its children where it listens, for anything else the socket
+     * is that of the dwm on $DISPLAY */
+    if(getenv("DWM_SOCKET") && *getenv("DWM_SOCKET"))
+        snprintf(path, sizeof path, "%s", getenv("DWM_SOCKET"));
+    else if(!ipc_path(path, sizeof path))
+        die("dwm-msg: socket path too long");
+    if((fd = ipc_connect(path)) < 0)
+        die("dwm-msg: cannot connect to %s:", path);
+    if(ipc_send(fd, req.data, req.len) < 0 || !(reply = ipc_recv(fd, &len)))
+        die("dwm-msg: connection to dwm lost");
+    puts(reply);
+    if(sub && !strncmp(reply, "{\"ok\":true", 10)) {
+        free(reply);
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        while((reply = ipc_recv(fd, &len))) {
+            puts(reply);
+            free(reply);
+        }
+        return EXIT_SUCCESS;
+    }
+    close(fd);
+    return strncmp(reply, "{\"ok\":true", 10) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
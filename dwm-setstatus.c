@@ -0,0 +1,31 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Publish a status segment to a running dwm without any X traffic:
+ *
+ *     dwm-setstatus 0 "build: ok"
+ *     dwm-setstatus 0              (clears segment 0)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "shmstatus.h"
+#include "util.h"
+
+int
+main(int argc, char *argv[])
+{
+    ShmStatus *s;
+    char *end;
+    long seg;
+
+    if(argc < 2 || argc > 3)
+        die("usage: dwm-setstatus segment [text]");
+    seg = strtol(argv[1], &end, 10);
+    if(*end || seg < 0 || seg >= SHMSTATUS_SEGS)
+        die("dwm-setstatus: segment must be 0..%d", SHMSTATUS_SEGS - 1);
+    if(!(s = shmstatus_map()))
+        die("dwm-setstatus: cannot map status block:");
+    shmstatus_publish(s, seg, argc == 3 ? argv[2] : "");
+    shmstatus_ring();
+    return EXIT_SUCCESS;
+}
@@ -20,35 +20,66 @@
  *
  * To understand everything else, start reading main().
  */
+#define _GNU_SOURCE /* POSIX_SPAWN_SETSID */
 #include <X11/X.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
 #include <X11/cursorfont.h>
+#include <X11/extensions/sync.h>
 #include <X11/keysym.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
 #include <pthread.h>
 #include <regex.h>
+#include <sched.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif /* XRANDR */
 #include <X11/Xft/Xft.h>
+#include <Imlib2.h>
 
 #include "drw.h"
+#include "icon.h"
+#include "ipc.h"
+#include "session.h"
+#include "shmstatus.h"
+#include "status.h"
 #include "util.h"
 
+/* children leave our session, or without POSIX_SPAWN_SETSID (glibc older
+ * than 2.26) at least our process group */
+#ifdef POSIX_SPAWN_SETSID
+#define SPAWN_DETACH POSIX_SPAWN_SETSID
+#else
+#define SPAWN_DETACH POSIX_SPAWN_SETPGROUP
+#endif
+
 /* macros */
 #define BUTTONMASK (ButtonPressMask | ButtonReleaseMask)
 #define CLEANMASK(mask)                                                       \
@@ -66,7 +97,7 @@
 #define WIDTH(X)             ((X)->w + 2 * (X)->bw)
 #define HEIGHT(X)            ((X)->h + 2 * (X)->bw)
 #define TAGMASK              ((1 << LENGTH(tags)) - 1)
-#define TEXTW(X, F)          (drw_fontset_getwidth(drw, (X), (F)) + lrpad)
+#define TEXTW(X, F)          (drw_fontset_getwidth(render.drw, (X), (F)) + lrpad)
 #define OPAQUE               0xffU
 
 /* enums */
@@ -103,6 +134,7 @@ enum
   NetWMWindowTypeNotification,
   NetClientList,
   NetWMWindowTypeDock,
+  NetWMPid,
   NetLast
 }; /* EWMH atoms */
 enum
@@ -114,6 +146,39 @@ enum
   WMLast
 }; /* default atoms */
 enum
+{
+  BarDraw,
+  BarCopy,
+  BarFree,
+  BarQuit
+}; /* bar frame types */
+enum
+{
+  IconNone,
+  IconSame,
+  IconNew
+}; /* icon fetch results */
+enum
+{
+  IpcArgNone,
+  IpcArgInt,
+  IpcArgUint,
+  IpcArgFloat,
+  IpcArgMfact,
+  IpcArgLayout
+}; /* ipc command argument types */
+enum
+{
+  IpcEvFocus,
+  IpcEvTag,
+  IpcEvFullscreen,
+  IpcEvTitle,
+  IpcEvManage,
+  IpcEvUnmanage,
+  IpcEvStatus,
+  IpcEvLast
+}; /* ipc events */
+enum
 {
   ClkTagBar,
   ClkLtSymbol,
@@ -181,11 +246,27 @@ typedef struct
 
 typedef struct Monitor Monitor;
 typedef struct Client Client;
+typedef struct Bar Bar;
+typedef struct BarFrame BarFrame;
+typedef struct BarLayout BarLayout;
+typedef struct Icon Icon;
+typedef struct IconJob IconJob;
+/* scaled icons are shared by every client of a class showing the same
+ * pixels */
+struct Icon
+{
+  char class[64];
+  uint64_t hash; /* of the source pixels */
+  DrwImage img; /* a cell of the icon atlas */
+  int refs;
+  Icon *next;
+};
 struct Client
 {
   char name[256], class[256], instance[256];
-  Picture icon;
-  unsigned int icw, ich;
+  Icon *icon;
+  int icondirty; /* _NET_WM_ICON changed, reload when next drawn */
+  unsigned int iconseq; /* of the last fetch posted to the icon worker */
   float mina, maxa;
   int x, y, w, h;
   int oldx, oldy, oldw, oldh;
@@ -200,8 +281,8 @@ struct Client
   float factorx;
   int borderpx;
   int hasrulebw;
-  Client *next;
-  Client *snext;
+  Client *next, *prev;   /* in mon->clients */
+  Client *snext, *sprev; /* in mon->stack */
   Monitor *mon;
   Window win;
 };
@@ -214,12 +295,42 @@ typedef struct
   const Arg arg;
 } Key;
 
+typedef struct
+{
+  const char *name;
+  void (*func)(const Arg *);
+  int argtype;
+} IpcCommand;
+
+typedef struct IpcClient IpcClient;
+struct IpcClient
+{
+  int fd;
+  IpcBuf in, out;
+  int wantout; /* waiting for the socket to drain */
+  unsigned int events; /* subscribed IpcEv bits */
+  /* events queued behind a slow reader, the oldest give way */
+  char *evring[64];
+  unsigned int evhead, evtail, dropped;
+  IpcClient *next;
+};
+
 typedef struct
 {
   const char *symbol;
   void (*arrange)(Monitor *);
 } Layout;
 
+typedef struct Watch Watch;
+struct Watch
+{
+  int fd;
+  void (*fn)(int fd);
+  int dead; /* unwatched, freed once the current batch of events is done */
+  int timer; /* a timerfd, expirations are read before fn is called */
+  Watch *next;
+};
+
 typedef struct Pertag Pertag;
 struct Monitor
 {
@@ -238,11 +349,15 @@ struct Monitor
   int showbar;
   int topbar;
   int hidsel;
-  Client *clients;
+  Client *clients, *clientstail;
   Client *sel;
-  Client *stack;
+  Client *stack, *stacktail;
   Monitor *next;
   Window barwin;
+  int barpending; /* frame dropped on a full render ring */
+  int dirty;      /* arrange deferred by a transaction */
+  int moved;      /* geometry or clients changed by updategeom */
+  char name[32];  /* RandR monitor name, which a change keeps */
   const Layout *lt[3];
   Pertag *pertag;
 };
@@ -264,6 +379,31 @@ typedef struct
   int iswarppointer;
 } Rule;
 
+typedef struct
+{
+  const char *const *cmd; /* a command bound to spawn */
+  unsigned int max;       /* spares kept at most, while launched often */
+} Warm;
+
+enum
+{
+  ToggleKill,
+  ToggleHide
+}; /* what runortoggle does to a running instance */
+
+typedef struct
+{
+  const char *class;
+  const char *const *cmd;
+  int action;
+} Toggle;
+
+typedef struct
+{
+  const char *name;
+  const char *const *cmd;
+} Service;
+
 /* function declarations */
 static void applyfactor(Client *c, const Rule *r);
 static void applyrules(Client *c);
@@ -273,11 +413,21 @@ static void arrange(Monitor *m);
 static void arrangemon(Monitor *m);
 static void attach(Client *c);
 static void attachabove(Client *c);
+static void attachafter(Client *c, Client *at);
 static void attachaside(Client *c);
 static void attachbelow(Client *c);
 static void attachbottom(Client *c);
 static void attachtop(Client *c);
 static void attachstack(Client *c);
+static void batchcommit(void);
+static int barframe(Monitor *m, BarFrame *f);
+static void barflush(void);
+static void barinit(void);
+static int barlayout(Window win, BarLayout *l);
+static void barpost(const BarFrame *f);
+static void barquit(void);
+static void barrender(Bar *b, const BarFrame *f);
+static void *barrun(void *arg);
 static void buttonpress(XEvent *e);
 static void initposition(Client *c);
 static void changerule(Client *c);
@@ -313,7 +463,7 @@ static void focusstackvis(const Arg *arg);
 static void focusstackhid(const Arg *arg);
 static void focusstack(int inc, int vis);
 static Atom getatomprop(Client *c, Atom prop);
-static Picture geticonprop(Window w, unsigned int *icw, unsigned int *ich);
+static int geticonprop(Display *d, IconJob *j);
 static int getrootptr(int *x, int *y);
 static long getstate(Window w);
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
@@ -322,17 +472,49 @@ static void grabkeys(void);
 static void hide(const Arg *arg);
 static void hideall(const Arg *arg);
 static void hidewin(Client *c);
+static void idlealarm(XEvent *e);
+static void idlearm(XSyncAlarm *alarm, XSyncValue value, XSyncTestType test);
+static void idleinit(void);
 static int isclassof(Client *c, int wmclass);
 static int istypeofdialog(Client *c);
 static int istypeofdock(Client *c);
 static int istypeofnotification(Client *c);
 static void incnmaster(const Arg *arg);
+static void ipcaccept(int fd);
+static const char *ipcbatch(const char *cmds);
+static void ipcdrop(IpcClient *ic);
+static void ipcevent(int ev, Client *c, Monitor *m, const char *text);
+static const char *ipcexec(const char *cmd);
+static const char *ipcparse(const char *cmd, const IpcCommand **ic, Arg *arg);
+static int ipcflush(IpcClient *ic);
+static void ipchandle(IpcClient *ic, const char *msg);
+static void ipcinit(void);
+static void ipcio(int fd);
+static int ipcquery(IpcBuf *r, const char *what);
+static const char *ipcsubscribe(IpcClient *ic, const char *names);
+static void ipcquit(void);
 static void keypress(XEvent *e);
+static void iconapply(Client *c, IconJob *j);
+static void icondone(int fd);
+static Icon *iconget(const char *class, uint64_t hash);
+static void iconinit(void);
+static int iconpost(const IconJob *j);
+static Icon *iconput(const char *class, uint64_t hash, const uint32_t *px,
+                     unsigned int w, unsigned int h);
+static void iconquit(void);
+static void iconrelease(void);
+static void *iconrun(void *arg);
+static void loadicon(Client *c);
+static void closeclient(Client *c);
 static void killclient(const Arg *arg);
 static void manage(Window w, XWindowAttributes *wa);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
 static int matchregex(const char *name, const char *reg);
+static void monchanged(void);
+#if defined(XINERAMA) || defined(XRANDR)
+static void monmigrate(Monitor *from, Monitor *to);
+#endif
 static void monocle(Monitor *m);
 static void motionnotify(XEvent *e);
 static void movemouse(const Arg *arg);
@@ -343,6 +525,7 @@ static Client *nexttiled(Client *c);
 static void pop(Client *c);
 static void propertynotify(XEvent *e);
 static void quit(const Arg *arg);
+static void unhideall(void);
 static Monitor *recttomon(int x, int y, int w, int h);
 static void resetnmaster(const Arg *arg);
 static void resize(Client *c, int x, int y, int w, int h, int interact);
@@ -350,35 +533,68 @@ static void resizebarwin(Monitor *m);
 static void resizeclient(Client *c, int x, int y, int w, int h);
 static void resizemouse(const Arg *arg);
 static void restack(Monitor *m);
+static void restart(const Arg *arg);
+static void restartexec(const char *argv0);
+static void restartfocus(void);
+static void restartload(int fd);
 static void rotatestack(const Arg *arg);
 static void run(void);
 static void runautostart(void);
+static void runortoggle(const Arg *arg);
 static void runpanel(void);
 static void scan(void);
 static int sendevent(Client *c, Atom proto);
 static void sendmon(Client *c, Monitor *m);
+static void serviceinit(void);
+static void servicequit(void);
+static void servicereap(pid_t pid);
+static void servicestart(size_t i);
+static void servicetick(int fd);
 static void setclientstate(Client *c, long state);
 static void setfocus(Client *c);
 static void setfullscreen(Client *c, int fullscreen);
 static void setgaps(const Arg *arg);
 static void setlayout(const Arg *arg);
 static void setmfact(const Arg *arg);
+static void sessionorder(Monitor *m);
+static unsigned int sessionrank(Client *c);
+static void sessionrecord(Client *c, SessionRecord *r);
+static const SessionRecord *sessionfind(Client *c);
+static int sessionhidden(Window w);
+static int sessionrestore(Client *c);
+static void sessionsave(Client *c);
+static void sessionsnapshot(void);
 static void setup(void);
+static void shmstatusbell(int fd);
+static void shmstatuscompose(char *text, size_t size);
+static void shmstatusframe(int fd);
+static void shmstatusinit(void);
 static void seturgent(Client *c, int urg);
 static void show(const Arg *arg);
 static void showall(const Arg *arg);
 static void showhide(Client *c);
 static void showwin(Client *c);
-static void sigchld(int unused);
+static void sigread(int fd);
 static int solitary(Client *c);
 static void spawn(const Arg *arg);
+static pid_t spawncmd(const char *const *cmd);
+static void spawninit(void);
+static const char *spawnpath(const char *const *argv, int refresh);
 static void spiral(Monitor *mon);
+static void startmark(const char *phase);
+static void statuscompose(char *text, size_t size);
+static void statusinit(void);
+static int statusrun(size_t i);
+static void statustick(int fd);
 static void tag(const Arg *arg);
 static void tagmon(const Arg *arg);
 static void tile(Monitor *m);
+static int timernew(unsigned int ms, int periodic, void (*fn)(int fd));
+static void timerset(int fd, unsigned int ms, int periodic);
 static void togglebar(const Arg *arg);
 static void togglefloating(const Arg *arg);
 static void togglelayer(const Arg *arg);
+static void togglereap(pid_t pid);
 static void togglermaster(const Arg *arg);
 static void toggletag(const Arg *arg);
 static void toggleview(const Arg *arg);
@@ -386,6 +602,7 @@ static void freeicon(Client *c);
 static void unfloatexceptlatest(Monitor *m, Client *c, int action);
 static void unfocus(Client *c, int setfocus);
 static void unmanage(Client *c, int destroyed);
+static void unwatch(int fd);
 static void unmapnotify(XEvent *e);
 static void updatebarpos(Monitor *m);
 static void updatebars(void);
@@ -403,7 +620,29 @@ static void viewafterclose(char *name);
 static void viewall(const Arg *arg);
 static Client *wintoclient(Window w);
 static Monitor *wintomon(Window w);
+static void walldone(int fd);
+static void wallgeom(void);
+static void wallinit(void);
+static void wallnext(void);
+static void wallquit(void);
+static Pixmap wallrender(char **files, size_t nfiles, size_t *next,
+                         unsigned int *seed, const XRectangle *mon, int nmon,
+                         int w, int h);
+static void *wallrun(void *arg);
+static void wallscan(const char *dir, int depth, char ***files, size_t *n);
+static void walltick(int fd);
+static int warmadopt(Window w);
+static void warmdrop(Window w);
+static void warmfill(int fd);
+static double warmheat(size_t i);
+static void warminit(void);
+static void warmquit(void);
+static void warmreap(pid_t pid);
+static int warmtake(const char *const *cmd);
 static void warppointer(Client *c);
+static void watch(int fd, void (*fn)(int fd));
+static void watchout(int fd, int on);
+static void watchreap(void);
 static int xerror(Display *dpy, XErrorEvent *ee);
 static int xerrordummy(Display *dpy, XErrorEvent *ee);
 static int xerrorstart(Display *dpy, XErrorEvent *ee);
@@ -441,6 +680,27 @@ static void (*handler[LASTEvent])(XEvent *)
         [PropertyNotify] = propertynotify,
         [UnmapNotify] = unmapnotify };
 static Atom wmatom[WMLast], netatom[NetLast];
+static char *wmatomnames[WMLast] = {
+  [WMProtocols] = "WM_PROTOCOLS",
+  [WMDelete] = "WM_DELETE_WINDOW",
+  [WMState] = "WM_STATE",
+  [WMTakeFocus] = "WM_TAKE_FOCUS",
+};
+static char *netatomnames[NetLast] = {
+  [NetSupported] = "_NET_SUPPORTED",
+  [NetWMName] = "_NET_WM_NAME",
+  [NetWMIcon] = "_NET_WM_ICON",
+  [NetWMState] = "_NET_WM_STATE",
+  [NetWMCheck] = "_NET_SUPPORTING_WM_CHECK",
+  [NetWMFullscreen] = "_NET_WM_STATE_FULLSCREEN",
+  [NetActiveWindow] = "_NET_ACTIVE_WINDOW",
+  [NetWMWindowType] = "_NET_WM_WINDOW_TYPE",
+  [NetWMWindowTypeDialog] = "_NET_WM_WINDOW_TYPE_DIALOG",
+  [NetWMWindowTypeNotification] = "_NET_WM_WINDOW_TYPE_NOTIFICATION",
+  [NetClientList] = "_NET_CLIENT_LIST",
+  [NetWMWindowTypeDock] = "_NET_WM_WINDOW_TYPE_DOCK",
+  [NetWMPid] = "_NET_WM_PID",
+};
 static int running = 1;
 static Cur *cursor[CurLast];
 static Clr **scheme;
@@ -448,6 +708,79 @@ static Display *dpy;
 static Drw *drw;
 static Monitor *mons, *selmon;
 static Window root, wmcheckwin;
+static int epfd;       /* epoll instance of the main loop */
+static int sigfd = -1; /* SIGCHLD, SIGTERM and SIGHUP, see sigread() */
+static sigset_t sigorig; /* signal mask children get back */
+/* wallpaper rotation, wallrun() decodes and scales the next image on its
+ * own connection, which is kept on close so the one shown outlives us */
+static struct
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  Display *dpy;
+  Atom rootpmap, esetroot;
+  int donefd; /* a pixmap became ready */
+  int timer;
+  int quit;
+  unsigned int gen; /* bumped when the monitors change */
+  int w, h, nmon;
+  XRectangle mon[8];
+  Pixmap ready; /* the next one, rendered again after each wallnext() */
+  Pixmap shown;
+  int stale; /* show the next one as soon as it is ready */
+} wall = { .lock = PTHREAD_MUTEX_INITIALIZER,
+           .wake = PTHREAD_COND_INITIALIZER,
+           .donefd = -1,
+           .timer = -1 };
+/* the locker, started by an XSync alarm on the server's IDLETIME */
+static struct
+{
+  int event; /* first XSync event */
+  XSyncCounter counter;
+  XSyncAlarm idle;  /* idle for locktime */
+  XSyncAlarm reset; /* active again */
+  pid_t pid;
+} idle;
+static posix_spawnattr_t spawnattr;
+extern char **environ;
+static Watch *watches; /* file descriptors the main loop waits on */
+static Icon *icons;
+/* images of freed icons that frames still queued for the renderer show,
+ * kept until it has consumed every frame posted up to head */
+static struct
+{
+  DrwImage img;
+  unsigned int head;
+} *deadicons;
+static size_t ndeadicons;
+static int ipcfd = -1;
+static char ipcpath[108];
+static IpcClient *ipcclients;
+static unsigned int ipcsubs; /* events anyone subscribed to */
+static Window lastfocus; /* for focus events */
+/* inside an IPC transaction arranging, restacking, bar drawing and the
+ * client list are only noted and done once on commit */
+static int batching, clientlistdirty;
+/* windows remembered from the previous session, only while scanning */
+static SessionRecord *sessrecs;
+static size_t nsessrecs;
+static int restoring;
+/* memfd handed to the next image by restart, and what the previous image
+ * handed us until scan has adopted its windows */
+static int restartfd = -1;
+static char *restartstate;
+/* -T, report how long each startup phase took */
+static int starttiming;
+#ifdef XRANDR
+static int randrevent = -1; /* -1 if the server lacks RandR 1.5 */
+#endif /* XRANDR */
+static const char *ipcevnames[] = {
+  [IpcEvFocus] = "focus",         [IpcEvTag] = "tag",
+  [IpcEvFullscreen] = "fullscreen", [IpcEvTitle] = "title",
+  [IpcEvManage] = "manage",       [IpcEvUnmanage] = "unmanage",
+  [IpcEvStatus] = "status",
+};
 
 static int useargb = 0;
 static Visual *visual;
@@ -467,6 +800,49 @@ pthread_mutex_t rule_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 #include "config.h"
 
+/* executables of the spawn commands in keys[] and buttons[], resolved
+ * against PATH once instead of in every child */
+static struct
+{
+  const char *const *argv;
+  char *path;
+} spawnpaths[LENGTH(keys) + LENGTH(buttons)];
+static size_t nspawnpaths;
+static char *spawnenvpath; /* the PATH they were resolved against */
+
+/* Spare instances of warmcmds[] started ahead of their key. Their windows
+ * are left unmanaged and unmapped until warmtake() hands one out. */
+static struct
+{
+  struct
+  {
+    pid_t pid;
+    Window win; /* None until it asks to be mapped */
+  } spare[8];
+  unsigned int n;
+  double heat; /* launches, one forgotten per minute */
+  struct timespec last;
+} warm[LENGTH(warmcmds)];
+static int warmtimer = -1;
+
+/* supervision state of services[] */
+static struct
+{
+  pid_t pid;
+  int timer;          /* restart backoff */
+  unsigned int fails; /* exits in a row soon after starting */
+  unsigned int restarts;
+  struct timespec started;
+  double spawnms; /* time posix_spawn took */
+} svc[LENGTH(services)];
+
+/* what runortoggle started or found for each of toggles[] */
+static struct
+{
+  pid_t pid;
+  Window win;
+} toggled[LENGTH(toggles)];
+
 struct Pertag
 {
   unsigned int curtag, prevtag;          /* current and previous tag */
@@ -477,6 +853,131 @@ struct Pertag
       *ltidxs[LENGTH(tags) + 1][2]; /* matrix of tags and layouts indexes  */
 };
 
+/* An in-place restart hands the next image a RestartHdr, one RestartMon
+ * per monitor, one SessionRecord per client in client list order, one
+ * RestartSvc per running service and one per running toggle command. */
+typedef struct
+{
+  char magic[8];
+  int32_t monsize; /* sizeof(RestartMon), changes with the tag count */
+  int32_t selmon, nmons, nrecs, nsvcs, ntoggles;
+} RestartHdr;
+
+typedef struct
+{
+  int32_t num, nmaster, gappx, rmaster, showbar;
+  float mfact;
+  uint32_t seltags, sellt, tagset[2];
+  int32_t lt[2]; /* layouts are passed as indexes into layouts[] */
+  uint32_t sel;
+  uint32_t curtag, prevtag;
+  int32_t nmasters[LENGTH(tags) + 1];
+  float mfacts[LENGTH(tags) + 1];
+  uint32_t sellts[LENGTH(tags) + 1];
+  int32_t ltidxs[LENGTH(tags) + 1][2];
+} RestartMon;
+
+/* a running service or toggle command, by service name or toggle class;
+ * the next image supervises it instead of starting another one */
+typedef struct
+{
+  int32_t pid;
+  char name[60];
+} RestartSvc;
+
+struct BarLayout
+{
+  int tagend[LENGTH(tags)]; /* right edge of each tag label */
+  int ltend;                /* right edge of the layout symbol */
+  int statusx;              /* left edge of the status text */
+};
+
+struct Bar
+{
+  Window win;
+  DrwBuf *buf; /* backing store, sized to the monitor */
+  int drawn;
+  BarLayout layout;
+  Bar *next;
+};
+
+struct BarFrame
+{
+  int type;
+  Window win;
+  unsigned int w;
+  unsigned int tagset, occ, urg;
+  int hoverx; /* pointer x while hovering the bar, -1 otherwise */
+  char ltsymbol[16];
+  int isselmon;
+  char status[256];
+  int dockw;
+  int hassel, drawtitle, isfloating, isfixed;
+  char title[256];
+  DrwImage icon;
+};
+
+/* an icon fetch: hash is that of the icon shown when posted and that of
+ * the fetched pixels on return, seq discards results overtaken by a newer
+ * fetch for the same window */
+struct IconJob
+{
+  Window win;
+  unsigned int seq;
+  uint64_t hash;
+  int status;
+  unsigned int w, h;
+  uint32_t px[ICONSIZE * ICONSIZE];
+};
+
+/* icon worker: fetches and scales _NET_WM_ICON on its own connection,
+ * fed and drained through single-producer rings */
+static struct
+{
+  Display *dpy;
+  pthread_t thread;
+  int jobfd, donefd; /* eventfds waking the worker and the main loop */
+  IconJob jobs[32], done[32];
+  unsigned int jobhead, jobtail, donehead, donetail;
+  unsigned int seq; /* last sequence number handed out, main thread */
+  int quit;         /* set by iconquit, the worker stops at once */
+} iconwork;
+
+/* state of the bar renderer, everything but the ring head and the bar
+ * layouts is owned by the render thread once it runs */
+static struct
+{
+  Display *dpy;
+  Drw *drw;
+  Clr **scheme;
+  pthread_t thread;
+  pthread_mutex_t lock; /* guards bars and their layouts */
+  Bar *bars;
+  int efd;
+  BarFrame ring[64];
+  unsigned int head, tail;
+  int overflow;
+} render = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* runtime state of the built-in status modules */
+static struct
+{
+  int fd; /* interval timer */
+  StatusState st;
+  char text[64];
+} statusmods[LENGTH(statusmodules)];
+
+/* shared memory status channel */
+static struct
+{
+  ShmStatus *block;
+  int bell;  /* doorbell fifo */
+  int frame; /* one-shot timer coalescing wakeups to one redraw per frame */
+  int armed;
+  unsigned int retry; /* ms until the next try while the block stays busy */
+  char last[SHMSTATUS_SEGS][SHMSTATUS_LEN]; /* last consistent snapshot */
+} shm = { .bell = -1, .frame = -1 };
+
 /* compile-time check if all tags fit into an unsigned int bit array. */
 struct NumTags
 {
@@ -681,6 +1182,15 @@ void
 arrange(Monitor *m)
 {
   XEvent ev;
+  if(batching)
+  {
+    if(m)
+      m->dirty = 1;
+    else
+      for(m = mons; m; m = m->next)
+        m->dirty = 1;
+    return;
+  }
   if(m)
     showhide(m->stack);
   else
@@ -735,8 +1245,7 @@ arrangemon(Monitor *m)
 void
 attach(Client *c)
 {
-  c->next = c->mon->clients;
-  c->mon->clients = c;
+  attachafter(c, NULL);
 }
 
 void
@@ -748,12 +1257,25 @@ attachabove(Client *c)
     attach(c);
     return;
   }
+  attachafter(c, c->mon->sel->prev);
+}
 
-  Client *at;
-  for(at = c->mon->clients; at->next != c->mon->sel; at = at->next)
-    ;
-  c->next = at->next;
-  at->next = c;
+/* Link c into its monitor's clients right after at, first if at is NULL. */
+void
+attachafter(Client *c, Client *at)
+{
+  Monitor *m = c->mon;
+
+  c->prev = at;
+  c->next = at ? at->next : m->clients;
+  if(c->next)
+    c->next->prev = c;
+  else
+    m->clientstail = c;
+  if(at)
+    at->next = c;
+  else
+    m->clients = c;
 }
 
 void
@@ -765,8 +1287,7 @@ attachaside(Client *c)
     attach(c);
     return;
   }
-  c->next = at->next;
-  at->next = c;
+  attachafter(c, at);
 }
 
 void
@@ -777,21 +1298,13 @@ attachbelow(Client *c)
     attach(c);
     return;
   }
-  c->next = c->mon->sel->next;
-  c->mon->sel->next = c;
+  attachafter(c, c->mon->sel);
 }
 
 void
 attachbottom(Client *c)
 {
-  Client *below = c->mon->clients;
-  for(; below && below->next; below = below->next)
-    ;
-  c->next = NULL;
-  if(below)
-    below->next = c;
-  else
-    c->mon->clients = c;
+  attachafter(c, c->mon->clientstail);
 }
 
 void
@@ -808,28 +1321,393 @@ attachtop(Client *c)
       n = below->isfloating || !ISVISIBLEONTAG(below, c->tags) ? n + 0 : n + 1,
   below = below->next)
     ;
-  c->next = NULL;
-  if(below)
-  {
-    c->next = below->next;
-    below->next = c;
-  }
-  else
-    c->mon->clients = c;
+  attachafter(c, below);
 }
 
 void
 attachstack(Client *c)
 {
+  c->sprev = NULL;
   c->snext = c->mon->stack;
+  if(c->snext)
+    c->snext->sprev = c;
+  else
+    c->mon->stacktail = c;
   c->mon->stack = c;
 }
 
+/* The bar is rendered by a dedicated thread which owns a second X connection
+ * together with the fonts, so slow text paths (font fallback matching, glyph
+ * rasterization) never block the event loop. The event loop only posts
+ * immutable BarFrame snapshots through a single-producer ring. */
+int
+barframe(Monitor *m, BarFrame *f)
+{
+  Client *c;
+
+  if(!m->showbar)
+  {
+    for(c = m->clients; c; c = c->next)
+    {
+      if(isclassof(c, XFCE4_PANEL))
+      {
+        hidewin(c);
+        break;
+      }
+    }
+    return 0;
+  }
+
+  memset(f, 0, sizeof(BarFrame));
+  f->type = BarDraw;
+  f->win = m->barwin;
+  f->w = m->ww;
+  f->tagset = m->tagset[m->seltags];
+  strncpy(f->ltsymbol, m->ltsymbol, sizeof f->ltsymbol - 1);
+  if((f->isselmon = m == selmon)) /* status is only drawn on selected monitor */
+    strncpy(f->status, stext, sizeof f->status - 1);
+
+  for(c = m->clients; c; c = c->next)
+  {
+    if(isclassof(c, XFCE4_PANEL))
+      f->dockw = c->w;
+    // prevent showing the panel as active application:
+    if(isclassof(c, XFCE4_PANEL) || isclassof(c, XFCE4_PANEL_PREFERENCES)
+       || isclassof(c, XFCE4_NOTIFYD) || isclassof(c, KMAGNIFIER)
+       || isclassof(c, KCLOCK) || isclassof(c, GNOME_CALCULATOR)
+       || isclassof(c, GNOME_CHARACTERS) || isclassof(c, GOLDENDICTNG))
+      continue;
+    f->occ |= c->tags;
+    if(c->isurgent)
+      f->urg |= c->tags;
+  }
+
+  if((c = m->sel))
+  {
+    f->hassel = 1;
+    f->drawtitle = !isclassof(c, XFCE4_PANEL) && !isclassof(c, KMAGNIFIER);
+    f->isfloating = c->isfloating;
+    f->isfixed = c->isfixed;
+    if(f->drawtitle)
+    {
+      if(c->icondirty)
+        loadicon(c);
+      strncpy(f->title, c->name, sizeof f->title - 1);
+      if(c->icon)
+        f->icon = c->icon->img;
+    }
+  }
+  return 1;
+}
+
+void
+barinit(void)
+{
+  XVisualInfo tpl, *vi;
+  int i, n;
+  Visual *rvisual = NULL;
+
+  if(!(render.dpy = XOpenDisplay(DisplayString(dpy))))
+    die("dwm: cannot open render connection");
+  fcntl(ConnectionNumber(render.dpy), F_SETFD, FD_CLOEXEC);
+  /* Visual pointers are per connection, look ours up by id */
+  tpl.visualid = XVisualIDFromVisual(visual);
+  if((vi = XGetVisualInfo(render.dpy, VisualIDMask, &tpl, &n)))
+  {
+    rvisual = vi->visual;
+    XFree(vi);
+  }
+  if(!rvisual)
+    die("dwm: render connection lacks visual 0x%lx", tpl.visualid);
+  render.drw = drw_create(render.dpy, screen, root, 1, 1, rvisual, depth, cmap);
+  if(!drw_fontset_create(render.drw, fonts, LENGTH(fonts)))
+    die("no fonts could be loaded.");
+  render.scheme = ecalloc(LENGTH(colors), sizeof(Clr *));
+  for(i = 0; i < LENGTH(colors); i++)
+    render.scheme[i] = drw_scm_create(render.drw, colors[i], alphas[i], 3);
+  if((render.efd = eventfd(0, EFD_CLOEXEC)) < 0)
+    die("dwm: eventfd:");
+}
+
+/* Copy the hit-test geometry of the last frame rendered into win. */
+int
+barlayout(Window win, BarLayout *l)
+{
+  Bar *b;
+
+  pthread_mutex_lock(&render.lock);
+  for(b = render.bars; b && b->win != win; b = b->next)
+    ;
+  if(b && b->drawn)
+    *l = b->layout;
+  pthread_mutex_unlock(&render.lock);
+  return b && b->drawn;
+}
+
+/* Called from the event loop only, never waits for the renderer unless a
+ * resource has to be released. */
+void
+barpost(const BarFrame *f)
+{
+  unsigned int head = render.head;
+  uint64_t one = 1;
+  Monitor *m;
+
+  while(head - __atomic_load_n(&render.tail, __ATOMIC_ACQUIRE)
+        == LENGTH(render.ring))
+  {
+    if(f->type == BarDraw || f->type == BarCopy)
+    {
+      /* the ring is full: remember the bar and repost it once the renderer
+       * caught up, see barflush() */
+      for(m = mons; m; m = m->next)
+        if(m->barwin == f->win)
+          m->barpending = 1;
+      __atomic_store_n(&render.overflow, 1, __ATOMIC_RELEASE);
+      write(render.efd, &one, sizeof one);
+      return;
+    }
+    write(render.efd, &one, sizeof one);
+    sched_yield();
+  }
+  render.ring[head % LENGTH(render.ring)] = *f;
+  __atomic_store_n(&render.head, head + 1, __ATOMIC_RELEASE);
+  XFlush(dpy); /* frames may refer to ids we just created */
+  write(render.efd, &one, sizeof one);
+}
+
+void
+barflush(void)
+{
+  Monitor *m;
+
+  for(m = mons; m; m = m->next)
+    if(m->barpending)
+    {
+      m->barpending = 0;
+      drawbar(m);
+    }
+}
+
+void
+barquit(void)
+{
+  BarFrame f = { .type = BarQuit };
+  size_t i;
+
+  barpost(&f);
+  pthread_join(render.thread, NULL);
+  for(i = 0; i < LENGTH(colors); i++)
+    free(render.scheme[i]);
+  free(render.scheme);
+  drw_free(render.drw);
+  XCloseDisplay(render.dpy);
+  close(render.efd);
+}
+
+void
+barrender(Bar *b, const BarFrame *f)
+{
+  Drw *d = render.drw;
+  Clr **scm = render.scheme;
+  BarLayout l = { 0 };
+  int x, w, tw = 0;
+  int boxs = d->fonts->h / 9;
+  int boxw = d->fonts->h / 6 + 2;
+  unsigned int i, twidth = 0;
+  int drawicon = 0;
+
+  if(!b->buf || b->buf->w != f->w || b->buf->h != bh)
+  {
+    drw_buf_free(d, b->buf);
+    b->buf = drw_buf_create(d, f->w, bh);
+  }
+  drw_setbuf(d, b->buf);
+
+  //	/* draw status first so it can be overdrawn by tags later */
+  l.statusx = f->w;
+  if(f->isselmon)
+  {
+    drw_setscheme(d, scm[SchemeStatus]);
+    tw = TEXTW(f->status, 0) - lrpad + 2; /* 2px right padding */
+    drw_text(d, f->w - tw - 2 * sp, 0, tw, bh, 0, f->status, 0, 0);
+    l.statusx = f->w - TEXTW(f->status, 0);
+  }
+
+  x = 0;
+  for(i = 0; i < LENGTH(tags); i++)
+  {
+    /* Do not draw vacant tags */
+    if(i > min_tag - 1 && !(f->occ & 1 << i || f->tagset & 1 << i))
+    {
+      l.tagend[i] = x;
+      continue;
+    }
+    w = TEXTW(tags[i], 0);
+    if(f->tagset & 1 << i)
+      drw_setscheme(d, scm[SchemeTagsSel]);
+    else if(f->hoverx > x && f->hoverx < x + w)
+      drw_setscheme(d, scm[SchemeTagsHover]);
+    else
+      drw_setscheme(d, scm[SchemeTagsNorm]);
+    drw_text(d, x, 0, w, bh, lrpad / 2, tags[i], f->urg & 1 << i, 0);
+    x += w;
+    l.tagend[i] = x;
+  }
+
+  w = TEXTW(f->ltsymbol, 0);
+  drw_setscheme(d, scm[SchemeTagsNorm]);
+  x = l.ltend = drw_text(d, x, 0, w, bh, lrpad / 2, f->ltsymbol, 0, 0);
+  if((w = f->w - tw - x) > bh)
+  {
+    if(f->hassel)
+    {
+      drw_setscheme(d, scm[SchemeInfoSel]);
+      // setup title width
+      twidth = f->w - x - 2 * sp - f->dockw;
+      drawicon = f->drawtitle && f->icon.picture;
+      drw_text(d, x, 0, twidth, bh,
+               lrpad / 2 + (drawicon ? f->icon.w + ICONSPACING : 0), f->title,
+               0, statusfontindex);
+      if(drawicon)
+        drw_image(d, x + lrpad / 2, (bh - f->icon.h) / 2, &f->icon);
+      drw_setscheme(d, scm[SchemeInfoSel]);
+      drw_rect(d, x + twidth, 0, f->w - x - twidth - 2 * sp, bh, 1, 1);
+      if(f->isfloating && f->drawtitle)
+        drw_rect(d, x + boxs, boxs, boxw, boxw, f->isfixed, 0);
+    }
+    else
+    {
+      drw_setscheme(d, scm[SchemeInfoSel]);
+      drw_rect(d, x, 0, f->w - x - 2 * sp, bh, 1, 1);
+    }
+  }
+  drw_map(d, f->win, 0, 0, f->w, bh);
+
+  pthread_mutex_lock(&render.lock);
+  b->layout = l;
+  b->drawn = 1;
+  pthread_mutex_unlock(&render.lock);
+}
+
+void *
+barrun(void *arg)
+{
+  BarFrame *f;
+  Bar *b, **bp;
+  XEvent ev;
+  uint64_t n;
+  unsigned int head, tail, t;
+  int drawn = 0;
+
+  for(;;)
+  {
+    if(read(render.efd, &n, sizeof n) < 0 && errno != EINTR)
+      break;
+    head = __atomic_load_n(&render.head, __ATOMIC_ACQUIRE);
+    for(tail = render.tail; tail != head; tail++)
+    {
+      f = &render.ring[tail % LENGTH(render.ring)];
+      if(f->type == BarQuit)
+        goto quit;
+      for(bp = &render.bars; *bp && (*bp)->win != f->win; bp = &(*bp)->next)
+        ;
+      switch(f->type)
+      {
+      case BarDraw:
+        /* only the newest frame of a bar is worth rendering */
+        for(t = tail + 1; t != head; t++)
+          if(render.ring[t % LENGTH(render.ring)].type == BarDraw
+             && render.ring[t % LENGTH(render.ring)].win == f->win)
+            break;
+        if(t != head)
+          break;
+        if(!*bp)
+        {
+          pthread_mutex_lock(&render.lock);
+          *bp = ecalloc(1, sizeof(Bar));
+          (*bp)->win = f->win;
+          pthread_mutex_unlock(&render.lock);
+        }
+        barrender(*bp, f);
+        if(!drawn)
+        {
+          XSync(render.dpy, False);
+          startmark("first bar");
+          drawn = 1;
+        }
+        break;
+      case BarCopy:
+        if(*bp && (*bp)->drawn)
+        {
+          drw_setbuf(render.drw, (*bp)->buf);
+          drw_map(render.drw, f->win, 0, 0, (*bp)->buf->w, bh);
+        }
+        break;
+      case BarFree:
+        if((b = *bp))
+        {
+          pthread_mutex_lock(&render.lock);
+          *bp = b->next;
+          pthread_mutex_unlock(&render.lock);
+          drw_buf_free(render.drw, b->buf);
+          free(b);
+        }
+        break;
+      }
+    }
+    __atomic_store_n(&render.tail, tail, __ATOMIC_RELEASE);
+    if(__atomic_exchange_n(&render.overflow, 0, __ATOMIC_ACQ_REL)
+       && wmcheckwin)
+    {
+      /* wake the event loop up so it reposts the frames it dropped */
+      memset(&ev, 0, sizeof ev);
+      ev.xclient.type = ClientMessage;
+      ev.xclient.window = wmcheckwin;
+      ev.xclient.format = 32;
+      XSendEvent(render.dpy, wmcheckwin, False, NoEventMask, &ev);
+      XFlush(render.dpy);
+    }
+  }
+quit:
+  while((b = render.bars))
+  {
+    render.bars = b->next;
+    drw_buf_free(render.drw, b->buf);
+    free(b);
+  }
+  XSync(render.dpy, False);
+  return NULL;
+}
+
+/* End a transaction: arrange what it touched, once. */
+void
+batchcommit(void)
+{
+  Monitor *m;
+
+  batching = 0;
+  for(m = mons; m; m = m->next)
+    if(m->dirty)
+    {
+      m->dirty = 0;
+      m->barpending = 0; /* restacking draws it */
+      arrange(m);
+    }
+  if(clientlistdirty)
+  {
+    clientlistdirty = 0;
+    updateclientlist();
+  }
+  barflush();
+}
+
 void
 buttonpress(XEvent *e)
 {
-  unsigned int i, x, click, occ;
+  unsigned int i, click;
   Arg arg = { 0 };
+  BarLayout l;
   Client *c;
   Monitor *m;
   XButtonPressedEvent *ev = &e->xbutton;
@@ -843,33 +1721,19 @@ buttonpress(XEvent *e)
     focus(NULL);
   }
 
-  if(ev->window == selmon->barwin)
+  if(ev->window == selmon->barwin && barlayout(selmon->barwin, &l))
   {
-    i = x = occ = 0;
-    for(c = m->clients; c; c = c->next)
-    {
-      if(isclassof(c, XFCE4_PANEL) || isclassof(c, XFCE4_NOTIFYD)
-         || isclassof(c, KMAGNIFIER) || isclassof(c, KCLOCK)
-         || isclassof(c, GNOME_CALCULATOR) || isclassof(c, GOLDENDICTNG))
-        continue;
-      occ |= c->tags;
-    }
-    do
-    {
-      /* Do not reserve space for vacant tags */
-      if(i > min_tag - 1 && !(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
-        continue;
-      x += TEXTW(tags[i], 0);
-    } while(ev->x >= x && ++i < LENGTH(tags));
+    for(i = 0; i < LENGTH(tags) && ev->x >= l.tagend[i]; i++)
+      ;
     if(i < LENGTH(tags))
     {
       click = ClkTagBar;
       arg.ui = 1 << i;
       fromclick = 1;
     }
-    else if(ev->x < x + TEXTW(selmon->ltsymbol, 0))
+    else if(ev->x < l.ltend)
       click = ClkLtSymbol;
-    else if(ev->x > selmon->ww - (int)TEXTW(stext, 0))
+    else if(ev->x > l.statusx)
       click = ClkStatusText;
     else
       click = ClkWinTitle;
@@ -1041,6 +1905,9 @@ cleanup(void)
   Monitor *m;
   size_t i;
 
+  /* the snapshot holds the session, unmanaging below must not journal */
+  sessionsnapshot();
+  session_close();
   view(&a);
   selmon->lt[selmon->sellt] = &foo;
   for(m = mons; m; m = m->next)
@@ -1055,6 +1922,13 @@ cleanup(void)
   for(i = 0; i < LENGTH(colors); i++)
     free(scheme[i]);
   free(scheme);
+  barquit();
+  iconquit();
+  wallquit();
+  ipcquit();
+  warmquit();
+  if(restartfd < 0) /* the next image keeps supervising them */
+    servicequit();
   XDestroyWindow(dpy, wmcheckwin);
   drw_free(drw);
   XSync(dpy, False);
@@ -1066,6 +1940,7 @@ void
 cleanupmon(Monitor *mon)
 {
   Monitor *m;
+  BarFrame f = { .type = BarFree, .win = mon->barwin };
 
   if(mon == mons)
     mons = mons->next;
@@ -1075,6 +1950,7 @@ cleanupmon(Monitor *mon)
       ;
     m->next = mon->next;
   }
+  barpost(&f);
   XUnmapWindow(dpy, mon->barwin);
   XDestroyWindow(dpy, mon->barwin);
   free(mon);
@@ -1102,6 +1978,21 @@ clientmessage(XEvent *e)
   }
 }
 
+void
+closeclient(Client *c)
+{
+  if(!sendevent(c, wmatom[WMDelete]))
+  {
+    XGrabServer(dpy);
+    XSetErrorHandler(xerrordummy);
+    XSetCloseDownMode(dpy, DestroyAll);
+    XKillClient(dpy, c->win);
+    XSync(dpy, False);
+    XSetErrorHandler(xerror);
+    XUngrabServer(dpy);
+  }
+}
+
 void
 configure(Client *c)
 {
@@ -1124,25 +2015,25 @@ configure(Client *c)
 void
 configurenotify(XEvent *e)
 {
-  Monitor *m;
   XConfigureEvent *ev = &e->xconfigure;
   int dirty;
 
-  /* TODO: updategeom handling sucks, needs to be simplified */
   if(ev->window == root)
   {
     dirty = (sw != ev->width || sh != ev->height);
     sw = ev->width;
     sh = ev->height;
-    if(updategeom() || dirty)
+#ifdef XRANDR
+    /* the monitors themselves are reported by randrnotify */
+    if(randrevent >= 0)
     {
-      drw_resize(drw, sw, bh);
-      updatebars();
-      for(m = mons; m; m = m->next)
-        resizebarwin(m);
-      focus(NULL);
-      arrange(NULL);
+      if(dirty)
+        monchanged();
+      return;
     }
+#endif /* XRANDR */
+    if(updategeom() || dirty)
+      monchanged();
   }
 }
 
@@ -1302,26 +2193,36 @@ destroynotify(XEvent *e)
 
   if((c = wintoclient(ev->window)))
     unmanage(c, 1);
+  else
+    warmdrop(ev->window);
 }
 
 void
 detach(Client *c)
 {
-  Client **tc;
-
-  for(tc = &c->mon->clients; *tc && *tc != c; tc = &(*tc)->next)
-    ;
-  *tc = c->next;
+  if(c->prev)
+    c->prev->next = c->next;
+  else
+    c->mon->clients = c->next;
+  if(c->next)
+    c->next->prev = c->prev;
+  else
+    c->mon->clientstail = c->prev;
 }
 
 void
 detachstack(Client *c)
 {
-  Client **tc, *t;
+  Client *t;
 
-  for(tc = &c->mon->stack; *tc && *tc != c; tc = &(*tc)->snext)
-    ;
-  *tc = c->snext;
+  if(c->sprev)
+    c->sprev->snext = c->snext;
+  else
+    c->mon->stack = c->snext;
+  if(c->snext)
+    c->snext->sprev = c->sprev;
+  else
+    c->mon->stacktail = c->sprev;
 
   if(c == c->mon->sel)
   {
@@ -1373,94 +2274,17 @@ dotogglefloating(Monitor *m, Client *c)
 void
 drawbar(Monitor *m)
 {
-  int x, w, tw = 0, dockw = 0;
-  int boxs = drw->fonts->h / 9;
-  int boxw = drw->fonts->h / 6 + 2;
-  unsigned int i, occ = 0, urg = 0, twidth = 0;
-  Client *c;
-  int drawtitle = 0, drawicon = 0;
+  BarFrame f;
 
-  if(!m->showbar)
+  if(batching)
   {
-    for(c = m->clients; c; c = c->next)
-    {
-      if(isclassof(c, XFCE4_PANEL))
-      {
-        hidewin(c);
-        break;
-      }
-    }
+    m->barpending = 1; /* drawn by barflush() after the handler */
     return;
   }
-
-  //	/* draw status first so it can be overdrawn by tags later */
-  if(m == selmon)
-  { /* status is only drawn on selected monitor */
-    drw_setscheme(drw, scheme[SchemeStatus]);
-    tw = TEXTW(stext, 0) - lrpad + 2; /* 2px right padding */
-    drw_text(drw, m->ww - tw - 2 * sp, 0, tw, bh, 0, stext, 0, 0);
-  }
-
-  for(c = m->clients; c; c = c->next)
-  {
-    if(isclassof(c, XFCE4_PANEL))
-      dockw = c->w;
-    // prevent showing the panel as active application:
-    if(isclassof(c, XFCE4_PANEL) || isclassof(c, XFCE4_PANEL_PREFERENCES)
-       || isclassof(c, XFCE4_NOTIFYD) || isclassof(c, KMAGNIFIER)
-       || isclassof(c, KCLOCK) || isclassof(c, GNOME_CALCULATOR)
-       || isclassof(c, GNOME_CHARACTERS) || isclassof(c, GOLDENDICTNG))
-      continue;
-    occ |= c->tags;
-    if(c->isurgent)
-      urg |= c->tags;
-  }
-  x = 0;
-  for(i = 0; i < LENGTH(tags); i++)
-  {
-    /* Do not draw vacant tags */
-    if(i > min_tag - 1 && !(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
-      continue;
-    w = TEXTW(tags[i], 0);
-    drw_setscheme(drw,
-                  scheme[m->tagset[m->seltags] & 1 << i ? SchemeTagsSel
-                                                        : SchemeTagsNorm]);
-    drw_text(drw, x, 0, w, bh, lrpad / 2, tags[i], urg & 1 << i, 0);
-    x += w;
-  }
-
-  w = TEXTW(m->ltsymbol, 0);
-  drw_setscheme(drw, scheme[SchemeTagsNorm]);
-  x = drw_text(drw, x, 0, w, bh, lrpad / 2, m->ltsymbol, 0, 0);
-  if((w = m->ww - tw - x) > bh)
-  {
-    if(m->sel)
-    {
-      drw_setscheme(drw, scheme[SchemeInfoSel]);
-      // setup title width
-      twidth = m->ww - x - 2 * sp - dockw;
-      // clang-format off
-            drawtitle = !isclassof(m->sel, XFCE4_PANEL) && !isclassof(m->sel, KMAGNIFIER);
-      // clang-format on
-      drawicon = drawtitle && m->sel->icon;
-      drw_text(drw, x, 0, twidth, bh,
-               lrpad / 2 + (drawicon ? m->sel->icw + ICONSPACING : 0),
-               drawtitle ? m->sel->name : "", 0, statusfontindex);
-      if(drawicon)
-        drw_pic(drw, x + lrpad / 2, (bh - m->sel->ich) / 2, m->sel->icw,
-                m->sel->ich, m->sel->icon);
-      drw_setscheme(drw, scheme[SchemeInfoSel]);
-      drw_rect(drw, x + twidth, 0, m->ww - x - twidth - 2 * sp, bh, 1, 1);
-      if(m->sel->isfloating && drawtitle)
-        drw_rect(drw, x + boxs, boxs, boxw, boxw, m->sel->isfixed, 0);
-    }
-    else
-    {
-      drw_setscheme(drw, scheme[SchemeInfoSel]);
-      drw_rect(drw, x, 0, m->ww - x - 2 * sp, bh, 1, 1);
-    }
-  }
-  drw_map(drw, m->barwin, 0, 0, m->ww, bh);
+  if(!barframe(m, &f))
+    return;
+  f.hoverx = -1;
+  barpost(&f);
 }
 
 void
@@ -1475,108 +2299,22 @@ drawbars(void)
 void
 drawhoverbar(Monitor *m, XMotionEvent *ev)
 {
-  int x, w, tw = 0, dockw = 0;
-  int boxs = drw->fonts->h / 9;
-  int boxw = drw->fonts->h / 6 + 2;
-  unsigned int i, occ = 0, urg = 0, twidth = 0;
-  Client *c;
-  int drawtitle = 0, drawicon = 0;
+  BarFrame f;
+  BarLayout l;
 
-  if(!m->showbar)
-  {
-    for(c = m->clients; c; c = c->next)
-    {
-      if(isclassof(c, XFCE4_PANEL))
-      {
-        hidewin(c);
-        break;
-      }
-    }
+  if(!barframe(m, &f))
     return;
-  }
-
-  //	/* draw status first so it can be overdrawn by tags later */
-  if(m == selmon)
-  { /* status is only drawn on selected monitor */
-    drw_setscheme(drw, scheme[SchemeStatus]);
-    tw = TEXTW(stext, 0) - lrpad + 2; /* 2px right padding */
-    drw_text(drw, m->ww - tw - 2 * sp, 0, tw, bh, 0, stext, 0, 0);
-  }
-
-  for(c = m->clients; c; c = c->next)
-  {
-    if(isclassof(c, XFCE4_PANEL))
-      dockw = c->w;
-    // prevent showing the panel as active application:
-    if(isclassof(c, XFCE4_PANEL) || isclassof(c, XFCE4_PANEL_PREFERENCES)
-       || isclassof(c, XFCE4_NOTIFYD) || isclassof(c, KMAGNIFIER)
-       || isclassof(c, KCLOCK) || isclassof(c, GNOME_CALCULATOR)
-       || isclassof(c, GNOME_CHARACTERS) || isclassof(c, GOLDENDICTNG))
-      continue;
-    occ |= c->tags;
-    if(c->isurgent)
-      urg |= c->tags;
-  }
 
   if(ev->x >= m->mx && ev->x < m->mx + m->mw)
     ev->x -= m->mx;
+  f.hoverx = (topbar ? ev->y < bh : ev->y > m->by) ? ev->x : -1;
+  barpost(&f);
 
-  x = 0;
-  for(i = 0; i < LENGTH(tags); i++)
-  {
-    /* Do not draw vacant tags */
-    if(i > min_tag - 1 && !(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
-      continue;
-    w = TEXTW(tags[i], 0);
-    if(m->tagset[m->seltags] & 1 << i)
-      drw_setscheme(drw, scheme[SchemeTagsSel]);
-    else if(ev->x > x && ev->x < x + w
-            && (topbar ? ev->y < bh : ev->y > m->by))
-      drw_setscheme(drw, scheme[SchemeTagsHover]);
-    else
-      drw_setscheme(drw, scheme[SchemeTagsNorm]);
-    drw_text(drw, x, 0, w, bh, lrpad / 2, tags[i], urg & 1 << i, 0);
-    x += w;
-  }
-
-  w = TEXTW(m->ltsymbol, 0);
-  drw_setscheme(drw, scheme[SchemeTagsNorm]);
-  x = drw_text(drw, x, 0, w, bh, lrpad / 2, m->ltsymbol, 0, 0);
-
-  if(ev->x < x)
+  /* the hand cursor follows the tags and layout symbol of the last frame */
+  if(barlayout(m->barwin, &l) && ev->x < l.ltend)
     XDefineCursor(dpy, m->barwin, cursor[CurHand]->cursor);
   else
     XDefineCursor(dpy, m->barwin, cursor[CurNormal]->cursor);
-
-  if((w = m->ww - tw - x) > bh)
-  {
-    if(m->sel)
-    {
-      drw_setscheme(drw, scheme[SchemeInfoSel]);
-      // setup title width
-      twidth = m->ww - x - 2 * sp - dockw;
-      // clang-format off
-            drawtitle = !isclassof(m->sel, XFCE4_PANEL) && !isclassof(m->sel, KMAGNIFIER);
-      // clang-format on
-      drawicon = drawtitle && m->sel->icon;
-      drw_text(drw, x, 0, twidth, bh,
-               lrpad / 2 + (drawicon ? m->sel->icw + ICONSPACING : 0),
-               drawtitle ? m->sel->name : "", 0, statusfontindex);
-      if(drawicon)
-        drw_pic(drw, x + lrpad / 2, (bh - m->sel->ich) / 2, m->sel->icw,
-                m->sel->ich, m->sel->icon);
-      drw_setscheme(drw, scheme[SchemeInfoSel]);
-      drw_rect(drw, x + twidth, 0, m->ww - x - twidth - 2 * sp, bh, 1, 1);
-      if(m->sel->isfloating && drawtitle)
-        drw_rect(drw, x + boxs, boxs, boxw, boxw, m->sel->isfixed, 0);
-    }
-    else
-    {
-      drw_setscheme(drw, scheme[SchemeInfoSel]);
-      drw_rect(drw, x, 0, m->ww - x - 2 * sp, bh, 1, 1);
-    }
-  }
-  drw_map(drw, m->barwin, 0, 0, m->ww, bh);
 }
 
 void
@@ -1588,27 +2326,21 @@ dwindle(Monitor *mon)
 void
 enqueue(Client *c)
 {
-  Client *l;
-  for(l = c->mon->clients; l && l->next; l = l->next)
-    ;
-  if(l)
-  {
-    l->next = c;
-    c->next = NULL;
-  }
+  attachafter(c, c->mon->clientstail);
 }
 
 void
 enqueuestack(Client *c)
 {
-  Client *l;
-  for(l = c->mon->stack; l && l->snext; l = l->snext)
-    ;
-  if(l)
-  {
-    l->snext = c;
-    c->snext = NULL;
-  }
+  Monitor *m = c->mon;
+
+  c->snext = NULL;
+  c->sprev = m->stacktail;
+  if(m->stacktail)
+    m->stacktail->snext = c;
+  else
+    m->stack = c;
+  m->stacktail = c;
 }
 
 void
@@ -1640,8 +2372,12 @@ expose(XEvent *e)
   Monitor *m;
   XExposeEvent *ev = &e->xexpose;
 
-  if(ev->count == 0 && (m = wintomon(ev->window)))
-    drawbar(m);
+  if(ev->count == 0 && (m = wintomon(ev->window)) && ev->window == m->barwin)
+  {
+    /* the backing buffer still holds the last frame, no need to re-render */
+    BarFrame f = { .type = BarCopy, .win = m->barwin };
+    barpost(&f);
+  }
 }
 
 void
@@ -1831,6 +2567,11 @@ focus(Client *c)
   }
   selmon->sel = c;
   drawbars();
+  if((c ? c->win : None) != lastfocus)
+  {
+    lastfocus = c ? c->win : None;
+    ipcevent(IpcEvFocus, c, selmon, NULL);
+  }
 }
 
 /* there are some broken focus acquiring clients needing extra handling */
@@ -1969,111 +2710,114 @@ getatomprop(Client *c, Atom prop)
   return atom;
 }
 
-static uint32_t
-prealpha(uint32_t p)
-{
-  uint8_t a = p >> 24u;
-  uint32_t rb = (a * (p & 0xFF00FFu)) >> 8u;
-  uint32_t g = (a * (p & 0x00FF00u)) >> 8u;
-  return (rb & 0xFF00FFu) | (g & 0x00FF00u) | (a << 24u);
-}
-
-Picture
-geticonprop(Window win, unsigned int *picw, unsigned int *pich)
+/* Fetch length CARD32 words of _NET_WM_ICON starting at offset; *left is
+ * set to the number of words remaining past the returned run. */
+static unsigned long *
+geticonwords(Display *d, Window win, long offset, long length,
+             unsigned long *n, unsigned long *left)
 {
   int format;
-  unsigned long n, extra, *p = NULL;
+  unsigned long extra, *p = NULL;
   Atom real;
 
-  if(XGetWindowProperty(dpy, win, netatom[NetWMIcon], 0L, LONG_MAX, False,
-                        AnyPropertyType, &real, &format, &n, &extra,
+  if(XGetWindowProperty(d, win, netatom[NetWMIcon], offset, length, False,
+                        AnyPropertyType, &real, &format, n, &extra,
                         (unsigned char **)&p)
      != Success)
-    return None;
-  if(n == 0 || format != 32)
+    return NULL;
+  if(*n == 0 || format != 32)
   {
     XFree(p);
-    return None;
+    return NULL;
   }
+  *left = extra / 4;
+  return p;
+}
+
+/* Pick the image closest to ICONSIZE by walking only the width/height
+ * headers, then fetch just that image's pixels and scale them into j,
+ * unless they hash to the icon already shown. Runs on the icon worker and,
+ * when its queue is full, on the main connection. */
+int
+geticonprop(Display *d, IconJob *j)
+{
+  unsigned long n, left, *p;
+  long off = 0, bstoff = -1;
+  uint32_t w, h, m, dist, bstd = UINT32_MAX, bstw = 0, bsth = 0;
+  int above = 0;
 
-  unsigned long *bstp = NULL;
-  uint32_t w, h, sz;
+  for(;;)
   {
-    unsigned long *i;
-    const unsigned long *end = p + n;
-    uint32_t bstd = UINT32_MAX, d, m;
-    for(i = p; i < end - 1; i += sz)
-    {
-      if((w = *i++) >= 16384 || (h = *i++) >= 16384)
-      {
-        XFree(p);
-        return None;
-      }
-      if((sz = w * h) > end - i)
-        break;
-      if((m = w > h ? w : h) >= ICONSIZE && (d = m - ICONSIZE) < bstd)
-      {
-        bstd = d;
-        bstp = i;
-      }
-    }
-    if(!bstp)
-    {
-      for(i = p; i < end - 1; i += sz)
-      {
-        if((w = *i++) >= 16384 || (h = *i++) >= 16384)
-        {
-          XFree(p);
-          return None;
-        }
-        if((sz = w * h) > end - i)
-          break;
-        if((d = ICONSIZE - (w > h ? w : h)) < bstd)
-        {
-          bstd = d;
-          bstp = i;
-        }
-      }
-    }
-    if(!bstp)
+    if(!(p = geticonwords(d, j->win, off, 2, &n, &left)))
+      break;
+    w = p[0];
+    h = n > 1 ? p[1] : 0;
+    XFree(p);
+    if(n < 2 || w == 0 || h == 0)
+      break;
+    if(w >= 16384 || h >= 16384)
+      return IconNone;
+    if((unsigned long)w * h > left)
+      break;
+    /* prefer the smallest image at least ICONSIZE, else the largest below */
+    m = w > h ? w : h;
+    if(m >= ICONSIZE ? (dist = m - ICONSIZE, !above || dist < bstd)
+                     : (!above && (dist = ICONSIZE - m) < bstd))
     {
-      XFree(p);
-      return None;
+      above = m >= ICONSIZE;
+      bstd = dist;
+      bstoff = off;
+      bstw = w;
+      bsth = h;
     }
+    if((unsigned long)w * h == left)
+      break;
+    off += 2 + (long)w * h;
+  }
+  if(bstoff < 0)
+    return IconNone;
+
+  w = bstw;
+  h = bsth;
+  if(!(p = geticonwords(d, j->win, bstoff + 2, (long)w * h, &n, &left)))
+    return IconNone;
+  if(n != (unsigned long)w * h)
+  {
+    XFree(p);
+    return IconNone;
   }
 
-  if((w = *(bstp - 2)) == 0 || (h = *(bstp - 1)) == 0)
+  uint64_t sum = 0xcbf29ce484222325ULL; /* FNV-1a */
+  uint32_t i, sz = w * h;
+  sum = (sum ^ w) * 0x100000001b3ULL;
+  sum = (sum ^ h) * 0x100000001b3ULL;
+  for(i = 0; i < sz; ++i)
+    sum = (sum ^ (uint32_t)p[i]) * 0x100000001b3ULL;
+  if(j->hash && sum == j->hash)
   {
     XFree(p);
-    return None;
+    return IconSame;
   }
+  j->hash = sum;
 
-  uint32_t icw, ich;
   if(w <= h)
   {
-    ich = ICONSIZE;
-    icw = w * ICONSIZE / h;
-    if(icw == 0)
-      icw = 1;
+    j->h = ICONSIZE;
+    j->w = w * ICONSIZE / h;
+    if(j->w == 0)
+      j->w = 1;
   }
   else
   {
-    icw = ICONSIZE;
-    ich = h * ICONSIZE / w;
-    if(ich == 0)
-      ich = 1;
+    j->w = ICONSIZE;
+    j->h = h * ICONSIZE / w;
+    if(j->h == 0)
+      j->h = 1;
   }
-  *picw = icw;
-  *pich = ich;
-
-  uint32_t i, *bstp32 = (uint32_t *)bstp;
-  for(sz = w * h, i = 0; i < sz; ++i)
-    bstp32[i] = prealpha(bstp[i]);
-
-  Picture ret = drw_picture_create_resized(drw, (char *)bstp, w, h, icw, ich);
+  icon_scale(j->px, j->w, j->h, p, w, h);
   XFree(p);
 
-  return ret;
+  return IconNew;
 }
 
 int
@@ -2290,88 +3034,837 @@ hidewin(Client *c)
   XSelectInput(dpy, root, ra.your_event_mask);
   XSelectInput(dpy, w, ca.your_event_mask);
   XUngrabServer(dpy);
+  sessionsave(c);
 }
 
+/* Install the outcome of an icon fetch for c. */
 void
-incnmaster(const Arg *arg)
+iconapply(Client *c, IconJob *j)
 {
-  selmon->nmaster = selmon->pertag->nmasters[selmon->pertag->curtag]
-      = MAX(selmon->nmaster + arg->i, 0);
-  arrange(selmon);
+  Icon *i = NULL;
+
+  if(j->status == IconSame)
+    return;
+  if(j->status == IconNew && !(i = iconget(c->class, j->hash)))
+  {
+    icon_cache_store(c->class, ICONSIZE, j->hash, j->px, j->w, j->h);
+    i = iconput(c->class, j->hash, j->px, j->w, j->h);
+  }
+  freeicon(c);
+  c->icon = i;
 }
 
-#ifdef XINERAMA
-static int
-isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
+/* Drain the icon worker's results; a window appears at once and its icon
+ * fills in here, a frame later. */
+void
+icondone(int fd)
 {
-  while(n--)
-    if(unique[n].x_org == info->x_org && unique[n].y_org == info->y_org
-       && unique[n].width == info->width && unique[n].height == info->height)
-      return 0;
+  unsigned int tail = iconwork.donetail;
+  uint64_t n;
+  IconJob *j;
+  Client *c;
+
+  if(read(fd, &n, sizeof n) < 0 && errno != EAGAIN)
+    return;
+  while(tail != __atomic_load_n(&iconwork.donehead, __ATOMIC_ACQUIRE))
+  {
+    j = &iconwork.done[tail % LENGTH(iconwork.done)];
+    if((c = wintoclient(j->win)) && c->iconseq == j->seq)
+    {
+      iconapply(c, j);
+      if(c == c->mon->sel)
+        drawbar(c->mon);
+    }
+    __atomic_store_n(&iconwork.donetail, ++tail, __ATOMIC_RELEASE);
+  }
+}
+
+/* Take a reference to the icon of class with source hash, 0 for any,
+ * uploading it from the disk cache if it is not in memory yet. */
+Icon *
+iconget(const char *class, uint64_t hash)
+{
+  const uint32_t *px;
+  unsigned int w, h;
+  Icon *i;
+
+  for(i = icons; i; i = i->next)
+  {
+    if((!hash || i->hash == hash)
+       && !strncmp(i->class, class, sizeof i->class - 1))
+    {
+      i->refs++;
+      return i;
+    }
+  }
+  if(!(px = icon_cache_find(class, ICONSIZE, &hash, &w, &h)))
+    return NULL;
+  return iconput(class, hash, px, w, h);
+}
+
+void
+iconinit(void)
+{
+  icon_kernel(); /* resolve the scaling kernel before the worker races us */
+  icon_cache_open();
+  if(!(iconwork.dpy = XOpenDisplay(DisplayString(dpy))))
+    die("dwm: cannot open icon connection");
+  fcntl(ConnectionNumber(iconwork.dpy), F_SETFD, FD_CLOEXEC);
+  if((iconwork.jobfd = eventfd(0, EFD_CLOEXEC)) < 0
+     || (iconwork.donefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+    die("dwm: eventfd:");
+  if(pthread_create(&iconwork.thread, NULL, iconrun, NULL))
+    die("dwm: cannot create icon thread");
+  watch(iconwork.donefd, icondone);
+}
+
+/* Queue a fetch for the icon worker, 0 if its queue is full. */
+int
+iconpost(const IconJob *j)
+{
+  unsigned int head = iconwork.jobhead;
+  uint64_t one = 1;
+
+  if(head - __atomic_load_n(&iconwork.jobtail, __ATOMIC_ACQUIRE)
+     == LENGTH(iconwork.jobs))
+    return 0;
+  iconwork.jobs[head % LENGTH(iconwork.jobs)] = *j;
+  __atomic_store_n(&iconwork.jobhead, head + 1, __ATOMIC_RELEASE);
+  write(iconwork.jobfd, &one, sizeof one);
   return 1;
 }
-#endif /* XINERAMA */
 
+Icon *
+iconput(const char *class, uint64_t hash, const uint32_t *px, unsigned int w,
+        unsigned int h)
+{
+  Icon *i;
+
+  iconrelease(); /* the cells may be free again */
+  i = ecalloc(1, sizeof(Icon));
+  strncpy(i->class, class, sizeof i->class - 1);
+  i->hash = hash;
+  i->refs = 1;
+  drw_image_create(drw, &i->img, px, w, h);
+  i->next = icons;
+  icons = i;
+  return i;
+}
+
+/* Give back the images of freed icons no queued frame refers to any more. */
 void
-keypress(XEvent *e)
+iconrelease(void)
 {
-  unsigned int i;
-  KeySym keysym;
-  XKeyEvent *ev;
+  unsigned int tail = __atomic_load_n(&render.tail, __ATOMIC_ACQUIRE);
+  size_t i;
 
-  ev = &e->xkey;
-  keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
-  for(i = 0; i < LENGTH(keys); i++)
-    if(keysym == keys[i].keysym
-       && CLEANMASK(keys[i].mod) == CLEANMASK(ev->state) && keys[i].func)
-      keys[i].func(&(keys[i].arg));
+  for(i = 0; i < ndeadicons;)
+    if((int)(tail - deadicons[i].head) >= 0)
+    {
+      drw_image_free(drw, &deadicons[i].img);
+      deadicons[i] = deadicons[--ndeadicons];
+    }
+    else
+      i++;
 }
 
+/* Stop the worker even while both rings are full: it may be waiting for
+ * us to take results, which we no longer do. */
 void
-killclient(const Arg *arg)
+iconquit(void)
 {
-  if(!selmon->sel)
-    return;
+  uint64_t one = 1;
+
+  __atomic_store_n(&iconwork.quit, 1, __ATOMIC_RELEASE);
+  write(iconwork.jobfd, &one, sizeof one);
+  /* the results still queued are for windows we are letting go of */
+  __atomic_store_n(&iconwork.donetail,
+                   __atomic_load_n(&iconwork.donehead, __ATOMIC_ACQUIRE),
+                   __ATOMIC_RELEASE);
+  pthread_join(iconwork.thread, NULL);
+  XCloseDisplay(iconwork.dpy);
+  close(iconwork.jobfd);
+  close(iconwork.donefd);
+}
 
-  if(!sendevent(selmon->sel, wmatom[WMDelete]))
+void *
+iconrun(void *arg)
+{
+  unsigned int tail = 0, head;
+  uint64_t n;
+  IconJob *j;
+
+  for(;;)
   {
-    XGrabServer(dpy);
-    XSetErrorHandler(xerrordummy);
-    XSetCloseDownMode(dpy, DestroyAll);
-    XKillClient(dpy, selmon->sel->win);
-    XSync(dpy, False);
-    XSetErrorHandler(xerror);
-    XUngrabServer(dpy);
+    if(read(iconwork.jobfd, &n, sizeof n) < 0 && errno != EINTR)
+      break;
+    while(tail != __atomic_load_n(&iconwork.jobhead, __ATOMIC_ACQUIRE))
+    {
+      if(__atomic_load_n(&iconwork.quit, __ATOMIC_ACQUIRE))
+        return NULL;
+      j = &iconwork.jobs[tail % LENGTH(iconwork.jobs)];
+      head = iconwork.donehead;
+      while(head - __atomic_load_n(&iconwork.donetail, __ATOMIC_ACQUIRE)
+            == LENGTH(iconwork.done))
+      {
+        if(__atomic_load_n(&iconwork.quit, __ATOMIC_ACQUIRE))
+          return NULL;
+        sched_yield();
+      }
+      /* fetch straight into the result slot, no copies of the pixels */
+      iconwork.done[head % LENGTH(iconwork.done)] = *j;
+      j = &iconwork.done[head % LENGTH(iconwork.done)];
+      j->status = geticonprop(iconwork.dpy, j);
+      __atomic_store_n(&iconwork.jobtail, ++tail, __ATOMIC_RELEASE);
+      __atomic_store_n(&iconwork.donehead, head + 1, __ATOMIC_RELEASE);
+      n = 1;
+      write(iconwork.donefd, &n, sizeof n);
+    }
+    if(__atomic_load_n(&iconwork.quit, __ATOMIC_ACQUIRE))
+      break;
   }
+  return NULL;
 }
 
 void
-manage(Window w, XWindowAttributes *wa)
+ipcaccept(int fd)
 {
-  Client *c, *t = NULL;
-  Window trans = None;
-  XWindowChanges wc;
-
-  c = ecalloc(1, sizeof(Client));
-  c->win = w;
-  /* geometry */
-  c->x = c->oldx = wa->x;
-  c->y = c->oldy = wa->y;
-  c->w = c->oldw = wa->width;
-  c->h = c->oldh = wa->height;
-  c->oldbw = wa->border_width;
+  IpcClient *ic;
+  int cfd;
 
-  updateicon(c);
-  updatetitle(c);
-  if(XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans)))
+  while((cfd = accept(fd, NULL, NULL)) >= 0)
   {
-    c->mon = t->mon;
-    c->tags = t->tags;
+    fcntl(cfd, F_SETFL, O_NONBLOCK);
+    fcntl(cfd, F_SETFD, FD_CLOEXEC);
+    ic = ecalloc(1, sizeof(IpcClient));
+    ic->fd = cfd;
+    ic->next = ipcclients;
+    ipcclients = ic;
+    watch(cfd, ipcio);
   }
-  else
-  {
-    c->mon = selmon;
-    applyrules(c);
+}
+
+/* Run an array of commands as one transaction: nothing runs unless all of
+ * them parse, and the model is only arranged, restacked and drawn once,
+ * after the last. */
+const char *
+ipcbatch(const char *cmds)
+{
+  static char err[64];
+  struct
+  {
+    const IpcCommand *ic;
+    Arg arg;
+  } op[256];
+  const char *v, *e;
+  unsigned int i, n = 0;
+
+  if(!(v = json_first(cmds)))
+    return "batch takes an array of commands";
+  for(; v; v = json_next(v), n++)
+  {
+    if(n == LENGTH(op))
+      return "batch too long";
+    if((e = ipcparse(v, &op[n].ic, &op[n].arg)))
+    {
+      snprintf(err, sizeof err, "command %u: %s", n, e);
+      return err;
+    }
+  }
+  batching = 1;
+  for(i = 0; i < n; i++)
+    op[i].ic->func(&op[i].arg);
+  batchcommit();
+  return NULL;
+}
+
+void
+ipcdrop(IpcClient *ic)
+{
+  IpcClient **ip;
+
+  ipcsubs = 0;
+  for(ip = &ipcclients; *ip != ic; ip = &(*ip)->next)
+    ipcsubs |= (*ip)->events;
+  *ip = ic->next;
+  for(ip = &ic->next; *ip; ip = &(*ip)->next)
+    ipcsubs |= (*ip)->events;
+  unwatch(ic->fd);
+  close(ic->fd);
+  while(ic->evtail != ic->evhead)
+    free(ic->evring[ic->evtail++ % LENGTH(ic->evring)]);
+  ipc_buf_free(&ic->in);
+  ipc_buf_free(&ic->out);
+  free(ic);
+}
+
+/* Queue an event for its subscribers. A subscriber whose queue is full
+ * loses its oldest event rather than ever stalling us. */
+void
+ipcevent(int ev, Client *c, Monitor *m, const char *text)
+{
+  IpcBuf b = { 0 };
+  IpcClient *ic;
+
+  if(!(ipcsubs & 1 << ev))
+    return;
+  ipc_buf_printf(&b, "{\"event\":\"%s\"", ipcevnames[ev]);
+  if(c)
+    ipc_buf_printf(&b, ",\"window\":%lu", c->win);
+  if(m)
+    ipc_buf_printf(&b, ",\"monitor\":%d", m->num);
+  switch(ev)
+  {
+  case IpcEvTag:
+    ipc_buf_printf(&b, ",\"tags\":%u", m->tagset[m->seltags]);
+    break;
+  case IpcEvFullscreen:
+    ipc_buf_printf(&b, ",\"fullscreen\":%s",
+                   c->isfullscreen ? "true" : "false");
+    break;
+  case IpcEvManage:
+    ipc_buf_printf(&b, ",\"class\":");
+    ipc_buf_str(&b, c->class);
+    ipc_buf_printf(&b, ",\"instance\":");
+    ipc_buf_str(&b, c->instance);
+    /* fall through */
+  case IpcEvTitle:
+    ipc_buf_printf(&b, ",\"name\":");
+    ipc_buf_str(&b, c->name);
+    break;
+  case IpcEvStatus:
+    ipc_buf_printf(&b, ",\"text\":");
+    ipc_buf_str(&b, text);
+    break;
+  }
+  ipc_buf_printf(&b, "}");
+  for(ic = ipcclients; ic; ic = ic->next)
+  {
+    if(!(ic->events & 1 << ev))
+      continue;
+    if(ic->evhead - ic->evtail == LENGTH(ic->evring))
+    {
+      free(ic->evring[ic->evtail++ % LENGTH(ic->evring)]);
+      ic->dropped++;
+    }
+    ic->evring[ic->evhead++ % LENGTH(ic->evring)] = strdup(b.data);
+    /* a broken client is dropped when its socket next reports ready, ic
+     * may be the one whose command is running */
+    if(!ipcflush(ic) && !ic->wantout)
+      watchout(ic->fd, ic->wantout = 1);
+  }
+  ipc_buf_free(&b);
+}
+
+/* Run one {"command": name, "arg": number} object, returning an error
+ * message or NULL. */
+const char *
+ipcexec(const char *cmd)
+{
+  const IpcCommand *ic;
+  const char *err;
+  Arg arg;
+
+  if((err = ipcparse(cmd, &ic, &arg)))
+    return err;
+  ic->func(&arg);
+  return NULL;
+}
+
+/* Resolve a command object to its function and argument. */
+const char *
+ipcparse(const char *cmd, const IpcCommand **ic, Arg *arg)
+{
+  const char *v = json_get(cmd, "arg");
+  char name[32];
+  double d = 0;
+  size_t i;
+
+  memset(arg, 0, sizeof *arg);
+  if(!json_str(json_get(cmd, "command"), name, sizeof name))
+    return "command must be a string";
+  for(i = 0; i < LENGTH(ipccommands) && strcmp(ipccommands[i].name, name); i++)
+    ;
+  if(i == LENGTH(ipccommands))
+    return "unknown command";
+  if(v && !json_num(v, &d))
+    return "arg must be a number";
+  switch(ipccommands[i].argtype)
+  {
+  case IpcArgInt:
+    /* converting anything else would be undefined */
+    if(!(d >= INT_MIN && d <= INT_MAX) || (int)d != d)
+      return "arg out of range";
+    arg->i = d;
+    break;
+  case IpcArgUint:
+    if(!(d >= 0 && d <= UINT_MAX) || (unsigned int)d != d)
+      return "arg out of range";
+    arg->ui = d;
+    break;
+  case IpcArgFloat:
+    arg->f = d;
+    break;
+  case IpcArgMfact:
+    /* always absolute, setmfact would take a fraction below 1 as a step
+     * and silently ignore what it cannot apply; checked the way it will */
+    arg->f = d + 1.0;
+    if(!(arg->f - 1.0 >= 0.05 && arg->f - 1.0 <= 0.95))
+      return "mfact must be between 0.05 and 0.95";
+    break;
+  case IpcArgLayout:
+    /* no argument toggles to the previous layout */
+    if(v && (d < 0 || d >= LENGTH(layouts) - 1))
+      return "no such layout";
+    arg->v = v ? &layouts[(int)d] : NULL;
+    break;
+  }
+  *ic = &ipccommands[i];
+  return NULL;
+}
+
+/* Write what the socket takes, 0 if the client has to be dropped. */
+int
+ipcflush(IpcClient *ic)
+{
+  char buf[64], *e;
+  ssize_t n;
+
+  for(;;)
+  {
+    n = 0;
+    /* a peer gone away is reported as EPIPE instead of killing us */
+    while(ic->out.len
+          && (n = send(ic->fd, ic->out.data, ic->out.len, MSG_NOSIGNAL)) > 0)
+      ipc_buf_drop(&ic->out, n);
+    if(n < 0 && errno != EAGAIN && errno != EINTR)
+      return 0;
+    if(ic->out.len || ic->evtail == ic->evhead)
+      break;
+    /* the socket drained, hand it the next queued event */
+    if(ic->dropped)
+    {
+      n = snprintf(buf, sizeof buf, "{\"event\":\"dropped\",\"count\":%u}",
+                   ic->dropped);
+      ipc_buf_frame(&ic->out, buf, n);
+      ic->dropped = 0;
+    }
+    e = ic->evring[ic->evtail++ % LENGTH(ic->evring)];
+    ipc_buf_frame(&ic->out, e, strlen(e));
+    free(e);
+  }
+  /* a client that stopped reading must not pin our memory */
+  if(ic->out.len > 4 * IPC_MAXMSG)
+    return 0;
+  if(!ic->out.len != !ic->wantout)
+  {
+    ic->wantout = ic->out.len != 0;
+    watchout(ic->fd, ic->wantout);
+  }
+  return 1;
+}
+
+void
+ipchandle(IpcClient *ic, const char *msg)
+{
+  IpcBuf r = { 0 };
+  const char *err = NULL;
+  char what[32];
+
+  if(json_get(msg, "command"))
+    err = ipcexec(msg);
+  else if(json_get(msg, "batch"))
+    err = ipcbatch(json_get(msg, "batch"));
+  else if(json_get(msg, "subscribe"))
+    err = ipcsubscribe(ic, json_get(msg, "subscribe"));
+  else if(json_str(json_get(msg, "query"), what, sizeof what))
+  {
+    if(!ipcquery(&r, what))
+      err = "unknown query";
+  }
+  else
+    err = "expected a command or a query";
+  if(err)
+  {
+    r.len = 0;
+    ipc_buf_printf(&r, "{\"ok\":false,\"error\":");
+    ipc_buf_str(&r, err);
+    ipc_buf_printf(&r, "}");
+  }
+  else if(!r.len)
+    ipc_buf_printf(&r, "{\"ok\":true}");
+  ipc_buf_frame(&ic->out, r.data, r.len);
+  ipc_buf_free(&r);
+}
+
+void
+ipcinit(void)
+{
+  if(!ipc_path(ipcpath, sizeof ipcpath)
+     || (ipcfd = ipc_listen(ipcpath)) < 0)
+  {
+    fprintf(stderr, "dwm: cannot listen on ipc socket %s\n", ipcpath);
+    return;
+  }
+  /* for dwm-msg run from our children, one inherited from a dwm we are
+   * nested in is not ours */
+  setenv("DWM_SOCKET", ipcpath, 1);
+  watch(ipcfd, ipcaccept);
+}
+
+void
+ipcio(int fd)
+{
+  IpcClient *ic;
+  char buf[4096], c;
+  ssize_t n;
+  uint32_t len;
+
+  for(ic = ipcclients; ic && ic->fd != fd; ic = ic->next)
+    ;
+  if(!ic)
+    return;
+  while((n = read(fd, buf, sizeof buf)) > 0 || (n < 0 && errno == EINTR))
+    if(n > 0)
+      ipc_buf_add(&ic->in, buf, n);
+  while(ic->in.len >= sizeof len)
+  {
+    memcpy(&len, ic->in.data, sizeof len);
+    if(len > IPC_MAXMSG)
+    {
+      ipcdrop(ic);
+      return;
+    }
+    if(ic->in.len < sizeof len + len)
+      break;
+    /* terminate the message in place for the JSON reader */
+    c = ic->in.data[sizeof len + len];
+    ic->in.data[sizeof len + len] = '\0';
+    ipchandle(ic, ic->in.data + sizeof len);
+    ic->in.data[sizeof len + len] = c;
+    ipc_buf_drop(&ic->in, sizeof len + len);
+  }
+  if(n == 0 || (n < 0 && errno != EAGAIN))
+  {
+    ipcdrop(ic);
+    return;
+  }
+  if(!ipcflush(ic))
+    ipcdrop(ic);
+}
+
+/* Append the reply to a query, 0 if what is unknown. */
+int
+ipcquery(IpcBuf *r, const char *what)
+{
+  const char *sep = "";
+  unsigned int i, occ = 0, urg = 0;
+  Monitor *m;
+  Client *c;
+
+  struct timespec now;
+  size_t k;
+
+  if(strcmp(what, "monitors") && strcmp(what, "tags")
+     && strcmp(what, "clients") && strcmp(what, "rules")
+     && strcmp(what, "services"))
+    return 0;
+  ipc_buf_printf(r, "{\"ok\":true,\"result\":[");
+  if(!strcmp(what, "monitors"))
+    for(m = mons; m; m = m->next, sep = ",")
+    {
+      ipc_buf_printf(r,
+                     "%s{\"num\":%d,\"x\":%d,\"y\":%d,\"width\":%d,"
+                     "\"height\":%d,\"tags\":%u,\"mfact\":%g,"
+                     "\"nmaster\":%d,\"showbar\":%s,\"selected\":%s,"
+                     "\"focused\":%lu,\"layout\":",
+                     sep, m->num, m->mx, m->my, m->mw, m->mh,
+                     m->tagset[m->seltags], m->mfact, m->nmaster,
+                     m->showbar ? "true" : "false",
+                     m == selmon ? "true" : "false", m->sel ? m->sel->win : 0);
+      ipc_buf_str(r, m->ltsymbol);
+      ipc_buf_printf(r, "}");
+    }
+  else if(!strcmp(what, "tags"))
+  {
+    for(c = selmon->clients; c; c = c->next)
+    {
+      occ |= c->tags;
+      if(c->isurgent)
+        urg |= c->tags;
+    }
+    for(i = 0; i < LENGTH(tags); i++, sep = ",")
+    {
+      ipc_buf_printf(r,
+                     "%s{\"index\":%u,\"mask\":%u,\"selected\":%s,"
+                     "\"occupied\":%s,\"urgent\":%s,\"name\":",
+                     sep, i, 1u << i,
+                     selmon->tagset[selmon->seltags] & 1 << i ? "true" : "false",
+                     occ & 1 << i ? "true" : "false",
+                     urg & 1 << i ? "true" : "false");
+      ipc_buf_str(r, tags[i]);
+      ipc_buf_printf(r, "}");
+    }
+  }
+  else if(!strcmp(what, "clients"))
+    for(m = mons; m; m = m->next)
+      for(c = m->clients; c; c = c->next, sep = ",")
+      {
+        ipc_buf_printf(r,
+                       "%s{\"window\":%lu,\"monitor\":%d,\"tags\":%u,"
+                       "\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,"
+                       "\"floating\":%s,\"fullscreen\":%s,\"urgent\":%s,"
+                       "\"focused\":%s,\"name\":",
+                       sep, c->win, m->num, c->tags, c->x, c->y, c->w, c->h,
+                       c->isfloating ? "true" : "false",
+                       c->isfullscreen ? "true" : "false",
+                       c->isurgent ? "true" : "false",
+                       c == selmon->sel ? "true" : "false");
+        ipc_buf_str(r, c->name);
+        ipc_buf_printf(r, ",\"class\":");
+        ipc_buf_str(r, c->class);
+        ipc_buf_printf(r, ",\"instance\":");
+        ipc_buf_str(r, c->instance);
+        ipc_buf_printf(r, "}");
+      }
+  else if(!strcmp(what, "services"))
+  {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for(k = 0; k < LENGTH(services); k++, sep = ",")
+    {
+      ipc_buf_printf(r, "%s{\"name\":", sep);
+      ipc_buf_str(r, services[k].name);
+      ipc_buf_printf(
+          r, ",\"pid\":%d,\"restarts\":%u,\"spawnms\":%.3f,\"uptime\":%.3f}",
+          (int)svc[k].pid, svc[k].restarts, svc[k].spawnms,
+          svc[k].pid > 0 ? (now.tv_sec - svc[k].started.tv_sec)
+                               + (now.tv_nsec - svc[k].started.tv_nsec) / 1e9
+                         : 0);
+    }
+  }
+  else
+    for(i = 0; i < LENGTH(rules); i++, sep = ",")
+    {
+      ipc_buf_printf(r, "%s{\"class\":", sep);
+      ipc_buf_str(r, rules[i].class);
+      ipc_buf_printf(r, ",\"instance\":");
+      ipc_buf_str(r, rules[i].instance);
+      ipc_buf_printf(r, ",\"title\":");
+      ipc_buf_str(r, rules[i].title);
+      ipc_buf_printf(r, ",\"tags\":%u,\"floating\":%s,\"monitor\":%d}",
+                     rules[i].tags, rules[i].isfloating ? "true" : "false",
+                     rules[i].monitor);
+    }
+  ipc_buf_printf(r, "]}");
+  return 1;
+}
+
+/* Subscribe ic to an array of event names. */
+const char *
+ipcsubscribe(IpcClient *ic, const char *names)
+{
+  unsigned int ev, mask = 0;
+  const char *v;
+  char name[16];
+
+  if(!(v = json_first(names)))
+    return "subscribe takes an array of event names";
+  for(; v; v = json_next(v))
+  {
+    if(!json_str(v, name, sizeof name))
+      return "event names must be strings";
+    for(ev = 0; ev < IpcEvLast && strcmp(ipcevnames[ev], name); ev++)
+      ;
+    if(ev == IpcEvLast)
+      return "unknown event";
+    mask |= 1 << ev;
+  }
+  ic->events |= mask;
+  ipcsubs |= mask;
+  return NULL;
+}
+
+void
+ipcquit(void)
+{
+  while(ipcclients)
+    ipcdrop(ipcclients);
+  if(ipcfd < 0)
+    return;
+  close(ipcfd);
+  unlink(ipcpath);
+}
+
+void
+idlealarm(XEvent *e)
+{
+  XSyncAlarmNotifyEvent *ev = (XSyncAlarmNotifyEvent *)e;
+  XSyncValue v, d;
+  int overflow;
+
+  if(ev->alarm == idle.reset)
+  {
+    XSyncIntToValue(&v, locktime * 1000);
+    idlearm(&idle.idle, v, XSyncPositiveComparison);
+    return;
+  }
+  if(ev->alarm != idle.idle || ev->state == XSyncAlarmDestroyed)
+    return;
+  /* any input brings the counter below where it is now */
+  XSyncIntToValue(&d, 1);
+  XSyncValueSubtract(&v, ev->counter_value, d, &overflow);
+  idlearm(&idle.reset, v, XSyncNegativeComparison);
+  if(selmon->sel && selmon->sel->isfullscreen)
+  {
+    /* watching something, look again a whole locktime later */
+    XSyncIntToValue(&d, locktime * 1000);
+    XSyncValueAdd(&v, ev->counter_value, d, &overflow);
+    idlearm(&idle.idle, v, XSyncPositiveComparison);
+  }
+  else if(idle.pid <= 0)
+    idle.pid = spawncmd(lockcmd);
+}
+
+/* Make alarm fire once IDLETIME compares to value as test says. */
+void
+idlearm(XSyncAlarm *alarm, XSyncValue value, XSyncTestType test)
+{
+  XSyncAlarmAttributes aa;
+  unsigned long flags = XSyncCACounter | XSyncCAValueType | XSyncCATestType
+                        | XSyncCAValue | XSyncCADelta | XSyncCAEvents;
+
+  aa.trigger.counter = idle.counter;
+  aa.trigger.value_type = XSyncAbsolute;
+  aa.trigger.test_type = test;
+  aa.trigger.wait_value = value;
+  XSyncIntToValue(&aa.delta, 0);
+  aa.events = True;
+  if(*alarm)
+    XSyncChangeAlarm(dpy, *alarm, flags, &aa);
+  else
+    *alarm = XSyncCreateAlarm(dpy, flags, &aa);
+}
+
+/* The server tells us when it has been idle for locktime, no polling. */
+void
+idleinit(void)
+{
+  XSyncSystemCounter *counters;
+  XSyncValue v;
+  int i, n, error, major, minor;
+
+  if(!locktime || !XSyncQueryExtension(dpy, &idle.event, &error)
+     || !XSyncInitialize(dpy, &major, &minor))
+    return;
+  if((counters = XSyncListSystemCounters(dpy, &n)))
+  {
+    for(i = 0; i < n; i++)
+      if(!strcmp(counters[i].name, "IDLETIME"))
+        idle.counter = counters[i].counter;
+    XSyncFreeSystemCounterList(counters);
+  }
+  if(!idle.counter)
+  {
+    fputs("dwm: no IDLETIME counter, idle locking disabled\n", stderr);
+    return;
+  }
+  XSyncIntToValue(&v, locktime * 1000);
+  idlearm(&idle.idle, v, XSyncPositiveComparison);
+}
+
+void
+incnmaster(const Arg *arg)
+{
+  selmon->nmaster = selmon->pertag->nmasters[selmon->pertag->curtag]
+      = MAX(selmon->nmaster + arg->i, 0);
+  arrange(selmon);
+}
+
+#ifdef XINERAMA
+static int
+isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
+{
+  while(n--)
+    if(unique[n].x_org == info->x_org && unique[n].y_org == info->y_org
+       && unique[n].width == info->width && unique[n].height == info->height)
+      return 0;
+  return 1;
+}
+#endif /* XINERAMA */
+
+void
+keypress(XEvent *e)
+{
+  unsigned int i;
+  KeySym keysym;
+  XKeyEvent *ev;
+
+  ev = &e->xkey;
+  keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
+  for(i = 0; i < LENGTH(keys); i++)
+    if(keysym == keys[i].keysym
+       && CLEANMASK(keys[i].mod) == CLEANMASK(ev->state) && keys[i].func)
+      keys[i].func(&(keys[i].arg));
+}
+
+void
+killclient(const Arg *arg)
+{
+  if(!selmon->sel)
+    return;
+  closeclient(selmon->sel);
+}
+
+void
+loadicon(Client *c)
+{
+  IconJob j;
+  Icon *i;
+
+  c->icondirty = 0;
+  /* a fresh client shows the icon last known for its class until its own
+   * has been fetched, which is kept if it turns out to be the same */
+  if(!c->icon && c->class[0] && (i = iconget(c->class, 0)))
+    c->icon = i;
+  j.win = c->win;
+  j.seq = c->iconseq = ++iconwork.seq;
+  j.hash = c->icon ? c->icon->hash : 0;
+  if(iconpost(&j))
+    return;
+  /* the worker is backed up, fetch in place */
+  j.status = geticonprop(dpy, &j);
+  iconapply(c, &j);
+}
+
+void
+manage(Window w, XWindowAttributes *wa)
+{
+  Client *c, *t = NULL;
+  Window trans = None;
+  XWindowChanges wc;
+  int restored = 0;
+
+  c = ecalloc(1, sizeof(Client));
+  c->win = w;
+  /* geometry */
+  c->x = c->oldx = wa->x;
+  c->y = c->oldy = wa->y;
+  c->w = c->oldw = wa->width;
+  c->h = c->oldh = wa->height;
+  c->oldbw = wa->border_width;
+
+  updateicon(c);
+  updatetitle(c);
+  if(XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans)))
+  {
+    c->mon = t->mon;
+    c->tags = t->tags;
+  }
+  else
+  {
+    c->mon = selmon;
+    if(!(restored = sessionrestore(c)))
+      applyrules(c);
   }
 
   if(c->x + WIDTH(c) > c->mon->wx + c->mon->ww)
@@ -2436,12 +3929,15 @@ manage(Window w, XWindowAttributes *wa)
   if(c->mon == selmon)
     unfocus(selmon->sel, 0);
   c->mon->sel = c;
-  initposition(c);
+  if(!restored)
+    initposition(c);
   arrange(c->mon);
   if(!HIDDEN(c))
     XMapWindow(dpy, c->win);
   warppointer(c);
   focus(NULL);
+  ipcevent(IpcEvManage, c, c->mon, NULL);
+  sessionsave(c);
 }
 
 void
@@ -2462,7 +3958,7 @@ maprequest(XEvent *e)
 
   if(!XGetWindowAttributes(dpy, ev->window, &wa) || wa.override_redirect)
     return;
-  if(!wintoclient(ev->window))
+  if(!wintoclient(ev->window) && !warmadopt(ev->window))
     manage(ev->window, &wa);
 }
 
@@ -2492,6 +3988,54 @@ matchregex(const char *name, const char *reg)
   return ret;
 }
 
+/* Catch the bars, the wallpapers and the monitors updategeom moved up
+ * with a new monitor setup. */
+void
+monchanged(void)
+{
+  Monitor *m;
+
+  updatebars();
+  wallgeom();
+  for(m = mons; m; m = m->next)
+    if(m->moved)
+    {
+      m->moved = 0;
+      resizebarwin(m);
+      arrange(m);
+    }
+  focus(NULL);
+}
+
+#if defined(XINERAMA) || defined(XRANDR)
+/* Hand all clients of a monitor going away to another, below its own. */
+void
+monmigrate(Monitor *from, Monitor *to)
+{
+  Client *c;
+
+  if(!from->clients)
+    return;
+  for(c = from->clients; c; c = c->next)
+    c->mon = to;
+  from->clients->prev = to->clientstail;
+  if(to->clientstail)
+    to->clientstail->next = from->clients;
+  else
+    to->clients = from->clients;
+  to->clientstail = from->clientstail;
+  from->stack->sprev = to->stacktail;
+  if(to->stacktail)
+    to->stacktail->snext = from->stack;
+  else
+    to->stack = from->stack;
+  to->stacktail = from->stacktail;
+  from->clients = from->clientstail = NULL;
+  from->stack = from->stacktail = from->sel = NULL;
+  to->moved = 1;
+}
+#endif
+
 void
 monocle(Monitor *m)
 {
@@ -2676,8 +4220,8 @@ nexttagged(Client *c)
 void
 movestack(const Arg *arg)
 {
-  Client *c = NULL, *p = NULL, *pc = NULL, *i;
-  if(!selmon->sel)
+  Client *c = NULL, *sel = selmon->sel, *cp, *sp;
+  if(!sel)
     return;
 
   if(arg->i > 0)
@@ -2694,39 +4238,37 @@ movestack(const Arg *arg)
   else
   {
     /* find the client before selmon->sel */
-    for(i = selmon->clients; i != selmon->sel; i = i->next)
-      if(ISVISIBLE(i) && !i->isfloating)
-        c = i;
+    for(c = selmon->sel->prev; c && (!ISVISIBLE(c) || c->isfloating);
+        c = c->prev)
+      ;
     if(!c)
-      for(; i; i = i->next)
-        if(ISVISIBLE(i) && !i->isfloating)
-          c = i;
-  }
-  /* find the client before selmon->sel and c */
-  for(i = selmon->clients; i && (!p || !pc); i = i->next)
-  {
-    if(i->next == selmon->sel)
-      p = i;
-    if(i->next == c)
-      pc = i;
+      for(c = selmon->clientstail; c && (!ISVISIBLE(c) || c->isfloating);
+          c = c->prev)
+        ;
   }
 
-  /* swap c and selmon->sel selmon->clients in the selmon->clients list */
-  if(c && c != selmon->sel)
+  /* swap c and selmon->sel in the selmon->clients list */
+  if(c && c != sel)
   {
-    Client *temp = selmon->sel->next == c ? selmon->sel : selmon->sel->next;
-    selmon->sel->next = c->next == selmon->sel ? c : c->next;
-    c->next = temp;
-
-    if(p && p != c)
-      p->next = c;
-    if(pc && pc != selmon->sel)
-      pc->next = selmon->sel;
-
-    if(selmon->sel == selmon->clients)
-      selmon->clients = c;
-    else if(c == selmon->clients)
-      selmon->clients = selmon->sel;
+    cp = c->prev;
+    sp = sel->prev;
+    if(cp == sel)
+    {
+      detach(sel);
+      attachafter(sel, c);
+    }
+    else if(sp == c)
+    {
+      detach(c);
+      attachafter(c, sel);
+    }
+    else
+    {
+      detach(sel);
+      attachafter(sel, cp);
+      detach(c);
+      attachafter(c, sp);
+    }
     arrange(selmon);
     if(c->mon == selmon && !isclassof(selmon->sel, XFCE4_PANEL)
        && selmon->sel->iswarppointer)
@@ -2872,18 +4414,7 @@ quit(const Arg *arg)
   {
     fclose(fd);
     remove(lockfile);
-    // fix: reloading dwm keeps all the hidden clients hidden
-    Monitor *m;
-    Client *c;
-    for(m = mons; m; m = m->next)
-    {
-      if(m)
-      {
-        for(c = m->stack; c; c = c->next)
-          if(c && HIDDEN(c))
-            showwin(c);
-      }
-    }
+    unhideall();
     running = 0;
   }
   else
@@ -2893,6 +4424,141 @@ quit(const Arg *arg)
   }
 }
 
+#ifdef XRANDR
+/* Bring mons in line with RandR's monitors. A monitor is told by its name,
+ * so it keeps its clients, tags and layouts when others come or go, and
+ * only those whose geometry changed are marked to be arranged again. */
+static int
+randrgeom(void)
+{
+  XRRMonitorInfo *info, t;
+  Monitor *m, *old, **mp, **op;
+  Atom *atoms;
+  char **names;
+  int i, n, dirty = 0;
+
+  if(!(info = XRRGetMonitors(dpy, root, True, &n)))
+    return 0;
+  if(n < 1)
+  {
+    XRRFreeMonitors(info);
+    if(mons)
+      return 0; /* all outputs off, keep what we have */
+    mons = createmon();
+    mons->mw = mons->ww = sw;
+    mons->mh = mons->wh = sh;
+    updatebarpos(mons);
+    return mons->moved = 1;
+  }
+  /* the primary one first, it is monitor 0 to the rules */
+  for(i = 1; i < n; i++)
+    if(info[i].primary)
+    {
+      t = info[0];
+      info[0] = info[i];
+      info[i] = t;
+      break;
+    }
+  atoms = ecalloc(n, sizeof(Atom));
+  names = ecalloc(n, sizeof(char *));
+  for(i = 0; i < n; i++)
+    atoms[i] = info[i].name;
+  if(!XGetAtomNames(dpy, atoms, n, names))
+    for(i = 0; i < n; i++)
+      names[i] = NULL;
+  old = mons;
+  mons = NULL;
+  mp = &mons;
+  for(i = 0; i < n; i++)
+  {
+    for(op = &old; *op && names[i] && strcmp((*op)->name, names[i]);
+        op = &(*op)->next)
+      ;
+    if(*op && names[i])
+    {
+      m = *op;
+      *op = m->next;
+    }
+    else if(!names[i] && old)
+    {
+      m = old; /* nameless, take them in order */
+      old = m->next;
+    }
+    else
+    {
+      m = createmon();
+      m->moved = dirty = 1;
+      if(names[i])
+        snprintf(m->name, sizeof m->name, "%s", names[i]);
+    }
+    m->next = NULL;
+    *mp = m;
+    mp = &m->next;
+    m->num = i;
+    if(info[i].x != m->mx || info[i].y != m->my || info[i].width != m->mw
+       || info[i].height != m->mh)
+    {
+      m->moved = dirty = 1;
+      m->mx = m->wx = info[i].x;
+      m->my = m->wy = info[i].y;
+      m->mw = m->ww = info[i].width;
+      m->mh = m->wh = info[i].height;
+      updatebarpos(m);
+    }
+    if(names[i])
+      XFree(names[i]);
+  }
+  free(names);
+  free(atoms);
+  XRRFreeMonitors(info);
+  /* the monitors gone hand their clients to the first */
+  *mp = old;
+  while((m = old))
+  {
+    old = m->next;
+    monmigrate(m, mons);
+    if(m == selmon)
+      selmon = mons;
+    cleanupmon(m);
+    dirty = 1;
+  }
+  return dirty;
+}
+
+static void
+randrinit(void)
+{
+  int error, major, minor;
+
+  if(!XRRQueryExtension(dpy, &randrevent, &error)
+     || !XRRQueryVersion(dpy, &major, &minor)
+     || major < 1 || (major == 1 && minor < 5))
+  {
+    randrevent = -1;
+    return;
+  }
+  XRRSelectInput(dpy, root, RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask
+                                | RROutputChangeNotifyMask);
+}
+
+/* One change of the outputs comes as a burst of events, the monitors
+ * are looked at once for those already queued. */
+static void
+randrnotify(XEvent *e)
+{
+  XEvent ev;
+
+  if(e->type == randrevent + RRScreenChangeNotify)
+    XRRUpdateConfiguration(e);
+  while(XCheckTypedEvent(dpy, randrevent + RRNotify, &ev))
+    ;
+  while(XCheckTypedEvent(dpy, randrevent + RRScreenChangeNotify, &ev))
+    XRRUpdateConfiguration(&ev);
+  if(updategeom())
+    monchanged();
+}
+#endif /* XRANDR */
+
 Monitor *
 recttomon(int x, int y, int w, int h)
 {
@@ -3051,6 +4717,11 @@ restack(Monitor *m)
   XEvent ev;
   XWindowChanges wc;
 
+  if(batching)
+  {
+    m->dirty = 1;
+    return;
+  }
   drawbar(m);
   if(!m->sel)
     return;
@@ -3064,16 +4735,254 @@ restack(Monitor *m)
     wc.sibling = m->barwin;
     for(c = m->stack; c; c = c->snext)
     {
-      if(!c->isfloating && ISVISIBLE(c))
+      if(!c->isfloating && ISVISIBLE(c))
+      {
+        XConfigureWindow(dpy, c->win, CWSibling | CWStackMode, &wc);
+        wc.sibling = c->win;
+      }
+    }
+  }
+  XSync(dpy, False);
+  while(XCheckMaskEvent(dpy, EnterWindowMask, &ev))
+    ;
+}
+
+/* Hand monitors, per tag state, client order and focus to a fresh image of
+ * ourselves through a memfd. The clients stay mapped and the children we
+ * started keep running, so the next image only has to adopt them. */
+void
+restart(const Arg *arg)
+{
+  RestartHdr h = { "dwmrst3", sizeof(RestartMon), 0, 0, 0, 0, 0 };
+  RestartMon *rm;
+  RestartSvc *rs;
+  SessionRecord *r;
+  size_t k;
+  Monitor *m;
+  Client *c;
+  size_t len;
+  char *buf;
+  int i, j, fd;
+
+  if(restartfd >= 0) /* already on its way */
+    return;
+  for(m = mons; m; m = m->next, h.nmons++)
+    for(c = m->clients; c; c = c->next)
+      h.nrecs++;
+  for(k = 0; k < LENGTH(services); k++)
+    h.nsvcs += svc[k].pid > 0;
+  for(k = 0; k < LENGTH(toggles); k++)
+    h.ntoggles += toggled[k].pid > 0;
+  h.selmon = selmon->num;
+  len = sizeof h + h.nmons * sizeof *rm + h.nrecs * sizeof *r
+        + (h.nsvcs + h.ntoggles) * sizeof *rs;
+  buf = ecalloc(1, len);
+  memcpy(buf, &h, sizeof h);
+  rm = (RestartMon *)(buf + sizeof h);
+  r = (SessionRecord *)(rm + h.nmons);
+  rs = (RestartSvc *)(r + h.nrecs);
+  for(k = 0; k < LENGTH(services); k++)
+    if(svc[k].pid > 0)
+    {
+      rs->pid = svc[k].pid;
+      strncpy(rs->name, services[k].name, sizeof rs->name - 1);
+      rs++;
+    }
+  /* a toggle's window may be override-redirect and never managed, its pid
+   * is all that finds it again */
+  for(k = 0; k < LENGTH(toggles); k++)
+    if(toggled[k].pid > 0)
+    {
+      rs->pid = toggled[k].pid;
+      strncpy(rs->name, toggles[k].class, sizeof rs->name - 1);
+      rs++;
+    }
+  for(m = mons; m; m = m->next, rm++)
+  {
+    rm->num = m->num;
+    rm->nmaster = m->nmaster;
+    rm->gappx = m->gappx;
+    rm->rmaster = m->rmaster;
+    rm->showbar = m->showbar;
+    rm->mfact = m->mfact;
+    rm->seltags = m->seltags;
+    rm->sellt = m->sellt;
+    rm->tagset[0] = m->tagset[0];
+    rm->tagset[1] = m->tagset[1];
+    rm->lt[0] = m->lt[0] - layouts;
+    rm->lt[1] = m->lt[1] - layouts;
+    rm->sel = m->sel ? m->sel->win : None;
+    rm->curtag = m->pertag->curtag;
+    rm->prevtag = m->pertag->prevtag;
+    for(i = 0; i <= LENGTH(tags); i++)
+    {
+      rm->nmasters[i] = m->pertag->nmasters[i];
+      rm->mfacts[i] = m->pertag->mfacts[i];
+      rm->sellts[i] = m->pertag->sellts[i];
+      for(j = 0; j < 2; j++)
+        rm->ltidxs[i][j] = m->pertag->ltidxs[i][j] - layouts;
+    }
+    for(c = m->clients; c; c = c->next)
+      sessionrecord(c, r++);
+  }
+  /* no MFD_CLOEXEC, the next image reads it */
+  if((fd = syscall(SYS_memfd_create, "dwm-restart", 0)) < 0
+     || write(fd, buf, len) != (ssize_t)len)
+  {
+    fprintf(stderr, "dwm: restart: %s\n", strerror(errno));
+    if(fd >= 0)
+      close(fd);
+    free(buf);
+    return;
+  }
+  free(buf);
+  restartfd = fd;
+  running = 0;
+}
+
+/* Called once everything is torn down and the display closed. A freshly
+ * installed binary is preferred over the one we are running. */
+void
+restartexec(const char *argv0)
+{
+  char fdstr[16];
+  char *argv[] = { (char *)argv0, "-r", fdstr, starttiming ? "-T" : NULL,
+                   NULL };
+
+  snprintf(fdstr, sizeof fdstr, "%d", restartfd);
+  pthread_sigmask(SIG_SETMASK, &sigorig, NULL);
+  execvp(argv0, argv);
+  execv("/proc/self/exe", argv);
+  die("dwm: restart: exec:");
+}
+
+/* Give every monitor back its focused client once scan has adopted them. */
+void
+restartfocus(void)
+{
+  RestartHdr *h = (RestartHdr *)restartstate;
+  RestartMon *rm;
+  Monitor *m;
+  Client *c;
+  int i;
+
+  if(!h)
+    return;
+  rm = (RestartMon *)(h + 1);
+  for(m = mons; m && m->num != h->selmon; m = m->next)
+    ;
+  if(m)
+    selmon = m;
+  for(i = 0; i < h->nmons; i++, rm++)
+    if((c = wintoclient(rm->sel)) && ISVISIBLE(c))
+    {
+      detachstack(c);
+      attachstack(c);
+      c->mon->sel = c;
+    }
+  focus(selmon->sel);
+  free(restartstate);
+  restartstate = NULL;
+}
+
+/* Take back the state restart wrote to fd. The monitors are set up again
+ * right away, the client records are left for scan, which prefers them to
+ * SESSION_FILE. A state written by a build with another tag count is
+ * ignored and the windows come back from SESSION_FILE instead. */
+void
+restartload(int fd)
+{
+  RestartHdr *h;
+  RestartMon *rm;
+  RestartSvc *rs;
+  struct stat st;
+  Monitor *m;
+  int i, j, n;
+  size_t k;
+
+  if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof *h)
+  {
+    close(fd);
+    return;
+  }
+  restartstate = ecalloc(1, st.st_size);
+  n = pread(fd, restartstate, st.st_size, 0);
+  close(fd);
+  h = (RestartHdr *)restartstate;
+  if(n != st.st_size || memcmp(h->magic, "dwmrst3", 8)
+     || h->monsize != sizeof *rm || h->nmons < 0 || h->nrecs < 0
+     || h->nsvcs < 0 || h->ntoggles < 0
+     || st.st_size != (off_t)(sizeof *h + h->nmons * sizeof *rm
+                              + h->nrecs * sizeof(SessionRecord)
+                              + (h->nsvcs + h->ntoggles) * sizeof *rs))
+  {
+    free(restartstate);
+    restartstate = NULL;
+    return;
+  }
+  rm = (RestartMon *)(h + 1);
+  for(i = 0; i < h->nmons; i++, rm++)
+  {
+    for(m = mons; m && m->num != rm->num; m = m->next)
+      ;
+    if(!m)
+      continue;
+    m->nmaster = rm->nmaster;
+    m->gappx = rm->gappx;
+    m->rmaster = rm->rmaster;
+    m->showbar = rm->showbar;
+    m->mfact = rm->mfact;
+    m->seltags = rm->seltags & 1;
+    m->sellt = rm->sellt & 1;
+    m->tagset[0] = rm->tagset[0] & TAGMASK ? rm->tagset[0] & TAGMASK : 1;
+    m->tagset[1] = rm->tagset[1] & TAGMASK ? rm->tagset[1] & TAGMASK : 1;
+    m->pertag->curtag = MIN(rm->curtag, LENGTH(tags));
+    m->pertag->prevtag = MIN(rm->prevtag, LENGTH(tags));
+    for(j = 0; j < 2; j++)
+      m->lt[j] = &layouts[rm->lt[j] >= 0 && rm->lt[j] < LENGTH(layouts)
+                              ? rm->lt[j]
+                              : 0];
+    for(n = 0; n <= LENGTH(tags); n++)
+    {
+      m->pertag->nmasters[n] = rm->nmasters[n];
+      m->pertag->mfacts[n] = rm->mfacts[n];
+      m->pertag->sellts[n] = rm->sellts[n] & 1;
+      for(j = 0; j < 2; j++)
+        m->pertag->ltidxs[n][j]
+            = &layouts[rm->ltidxs[n][j] >= 0
+                               && rm->ltidxs[n][j] < LENGTH(layouts)
+                           ? rm->ltidxs[n][j]
+                           : 0];
+    }
+    strncpy(m->ltsymbol, m->lt[m->sellt]->symbol, sizeof m->ltsymbol - 1);
+    updatebarpos(m);
+    resizebarwin(m);
+  }
+  sessrecs = ecalloc(h->nrecs ? h->nrecs : 1, sizeof *sessrecs);
+  memcpy(sessrecs, rm, h->nrecs * sizeof *sessrecs);
+  nsessrecs = h->nrecs;
+  /* services are still our children, exec does not change the pid. One
+   * that exited meanwhile was reaped by setup, or is reaped here, and is
+   * left for serviceinit to start again */
+  rs = (RestartSvc *)((SessionRecord *)rm + h->nrecs);
+  for(i = 0; i < h->nsvcs; i++, rs++)
+    for(k = 0; k < LENGTH(services); k++)
+      if(!svc[k].pid && !strncmp(rs->name, services[k].name, sizeof rs->name - 1))
       {
-        XConfigureWindow(dpy, c->win, CWSibling | CWStackMode, &wc);
-        wc.sibling = c->win;
+        if(waitpid(rs->pid, NULL, WNOHANG) != 0)
+          break;
+        svc[k].pid = rs->pid;
+        clock_gettime(CLOCK_MONOTONIC, &svc[k].started);
+        break;
+      }
+  for(i = 0; i < h->ntoggles; i++, rs++)
+    for(k = 0; k < LENGTH(toggles); k++)
+      if(!toggled[k].pid && !strncmp(rs->name, toggles[k].class, sizeof rs->name - 1))
+      {
+        if(waitpid(rs->pid, NULL, WNOHANG) == 0)
+          toggled[k].pid = rs->pid;
+        break;
       }
-    }
-  }
-  XSync(dpy, False);
-  while(XCheckMaskEvent(dpy, EnterWindowMask, &ev))
-    ;
 }
 
 void
@@ -3086,8 +4995,8 @@ rotatestack(const Arg *arg)
   f = selmon->sel;
   if(arg->i > 0)
   {
-    for(c = nexttiled(selmon->clients); c && nexttiled(c->next);
-        c = nexttiled(c->next))
+    for(c = selmon->clientstail;
+        c && (c->isfloating || !ISVISIBLE(c) || HIDDEN(c)); c = c->prev)
       ;
     if(c)
     {
@@ -3118,11 +5027,53 @@ void
 run(void)
 {
   XEvent ev;
+  struct epoll_event events[16];
+  uint64_t expirations;
+  Watch *w;
+  int i, n;
+
   /* main event loop */
   XSync(dpy, False);
-  while(running && !XNextEvent(dpy, &ev))
-    if(handler[ev.type])
-      handler[ev.type](&ev); /* call handler */
+  while(running)
+  {
+    /* Xlib may already have queued events read along with replies, so drain
+     * its queue before going to sleep on the connection */
+    while(running && XPending(dpy))
+    {
+      XNextEvent(dpy, &ev);
+      if(ev.type < LASTEvent && handler[ev.type])
+        handler[ev.type](&ev); /* call handler */
+      else if(idle.counter && ev.type == idle.event + XSyncAlarmNotify)
+        idlealarm(&ev);
+#ifdef XRANDR
+      else if(randrevent >= 0
+              && (ev.type == randrevent + RRScreenChangeNotify
+                  || ev.type == randrevent + RRNotify))
+        randrnotify(&ev);
+#endif /* XRANDR */
+      barflush();
+    }
+    if(!running)
+      break;
+    if((n = epoll_wait(epfd, events, LENGTH(events), -1)) < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      die("dwm: epoll_wait:");
+    }
+    for(i = 0; i < n && running; i++)
+    {
+      if((w = events[i].data.ptr)->dead || !w->fn)
+        continue;
+      /* a timer rearmed since epoll_wait returned has nothing to read */
+      if(w->timer
+         && read(w->fd, &expirations, sizeof expirations) != sizeof expirations)
+        continue;
+      w->fn(w->fd);
+      barflush();
+    }
+    watchreap();
+  }
 }
 
 void
@@ -3132,6 +5083,7 @@ runautostart(void)
   char *path;
   char *xdgdatahome;
   char *home;
+  char *blockpath;
   struct stat sb;
 
   if((home = getenv("HOME")) == NULL) /* this is almost impossible */
@@ -3186,29 +5138,58 @@ runautostart(void)
     }
   }
 
-  /* try the blocking script first */
-  path = ecalloc(1, strlen(pathpfx) + strlen(autostartblocksh) + 2);
-  if(sprintf(path, "%s/%s", pathpfx, autostartblocksh) <= 0)
-  {
-    free(path);
-    free(pathpfx);
-  }
+  /* one shell runs both scripts, the blocking one first, while we carry
+   * on and manage the windows they open */
+  blockpath = ecalloc(1, strlen(pathpfx) + strlen(autostartblocksh) + 2);
+  path = ecalloc(1, strlen(pathpfx) + strlen(autostartsh) + 2);
+  sprintf(blockpath, "%s/%s", pathpfx, autostartblocksh);
+  sprintf(path, "%s/%s", pathpfx, autostartsh);
+  if(!access(blockpath, X_OK) || !access(path, X_OK))
+    spawncmd((const char *[]){ "/bin/sh", "-c",
+                               "[ -x \"$1\" ] && \"$1\"; "
+                               "[ -x \"$2\" ] && exec \"$2\"",
+                               "dwm-autostart", blockpath, path, NULL });
+  free(pathpfx);
+  free(blockpath);
+  free(path);
+}
 
-  if(access(path, X_OK) == 0)
-    system(path);
+/* Start the toggle's command, or hide, show or end the instance running.
+ * The window found is remembered, so only the first press after a
+ * restart looks for it by class. */
+void
+runortoggle(const Arg *arg)
+{
+  const Toggle *t = arg->v;
+  size_t i = t - toggles;
+  Monitor *m;
+  Client *c = wintoclient(toggled[i].win);
 
-  /* now the non-blocking script */
-  if(sprintf(path, "%s/%s", pathpfx, autostartsh) <= 0)
+  for(m = mons; m && !c; m = m->next)
+    for(c = m->clients; c && strcmp(c->class, t->class); c = c->next)
+      ;
+  toggled[i].win = c ? c->win : None;
+  if(t->action == ToggleHide && c)
   {
-    free(path);
-    free(pathpfx);
+    if(HIDDEN(c))
+    {
+      showwin(c);
+      if(ISVISIBLE(c))
+        focus(c);
+    }
+    else
+    {
+      hidewin(c);
+      focus(NULL);
+      arrange(c->mon);
+    }
   }
-
-  if(access(path, X_OK) == 0)
-    system(strcat(path, " &"));
-
-  free(pathpfx);
-  free(path);
+  else if(t->action == ToggleKill && toggled[i].pid > 0)
+    kill(toggled[i].pid, SIGTERM); /* windowless ones too */
+  else if(t->action == ToggleKill && c)
+    closeclient(c);
+  else if(toggled[i].pid <= 0) /* not still starting up */
+    toggled[i].pid = spawncmd(t->cmd);
 }
 
 void
@@ -3227,7 +5208,13 @@ scan(void)
   unsigned int i, num;
   Window d1, d2, *wins = NULL;
   XWindowAttributes wa;
+  Monitor *m;
 
+  /* adopt the windows as one transaction, restoring what the last session
+   * knew about them instead of applying rules */
+  if(!sessrecs)
+    nsessrecs = session_load(SESSION_FILE, &sessrecs);
+  restoring = batching = 1;
   if(XQueryTree(dpy, root, &d1, &d2, &wins, &num))
   {
     for(i = 0; i < num; i++)
@@ -3235,7 +5222,8 @@ scan(void)
       if(!XGetWindowAttributes(dpy, wins[i], &wa) || wa.override_redirect
          || XGetTransientForHint(dpy, wins[i], &d1))
         continue;
-      if(wa.map_state == IsViewable || getstate(wins[i]) == IconicState)
+      if(wa.map_state == IsViewable || getstate(wins[i]) == IconicState
+         || sessionhidden(wins[i]))
         manage(wins[i], &wa);
     }
     for(i = 0; i < num; i++)
@@ -3243,12 +5231,21 @@ scan(void)
       if(!XGetWindowAttributes(dpy, wins[i], &wa))
         continue;
       if(XGetTransientForHint(dpy, wins[i], &d1)
-         && (wa.map_state == IsViewable || getstate(wins[i]) == IconicState))
+         && (wa.map_state == IsViewable || getstate(wins[i]) == IconicState
+             || sessionhidden(wins[i])))
         manage(wins[i], &wa);
     }
     if(wins)
       XFree(wins);
   }
+  for(m = mons; m; m = m->next)
+    sessionorder(m);
+  free(sessrecs);
+  sessrecs = NULL;
+  nsessrecs = restoring = 0;
+  batchcommit();
+  session_open(SESSION_FILE);
+  sessionsnapshot();
 }
 
 void
@@ -3292,6 +5289,91 @@ sendmon(Client *c, Monitor *m)
   attachstack(c);
   focus(NULL);
   arrange(NULL);
+  sessionsave(c);
+}
+
+/* Start every service that is not running yet, each without waiting on
+ * the others. */
+void
+serviceinit(void)
+{
+  size_t i;
+
+  for(i = 0; i < LENGTH(services); i++)
+  {
+    svc[i].timer = timernew(0, 0, servicetick);
+    if(!svc[i].pid)
+      servicestart(i);
+  }
+}
+
+void
+servicequit(void)
+{
+  size_t i;
+
+  for(i = 0; i < LENGTH(services); i++)
+    if(svc[i].pid > 0)
+      kill(svc[i].pid, SIGTERM);
+}
+
+/* A service exited, start it again after a delay that doubles with every
+ * exit within 10s of starting, up to a minute. */
+void
+servicereap(pid_t pid)
+{
+  struct timespec now;
+  double up;
+  unsigned int ms;
+  size_t i;
+
+  for(i = 0; i < LENGTH(services) && svc[i].pid != pid; i++)
+    ;
+  if(i == LENGTH(services))
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  up = (now.tv_sec - svc[i].started.tv_sec)
+       + (now.tv_nsec - svc[i].started.tv_nsec) / 1e9;
+  svc[i].fails = up < 10 ? svc[i].fails + 1 : 0;
+  ms = MIN(60000, 500u << MIN(svc[i].fails, 7));
+  svc[i].pid = 0;
+  fprintf(stderr, "dwm: service %s exited after %.1fs, restarting in %ums\n",
+          services[i].name, up, ms);
+  timerset(svc[i].timer, ms, 0);
+}
+
+void
+servicestart(size_t i)
+{
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &svc[i].started);
+  if((svc[i].pid = spawncmd(services[i].cmd)) < 0)
+  {
+    /* retried like a service that exited at once */
+    svc[i].pid = 0;
+    svc[i].fails++;
+    timerset(svc[i].timer, MIN(60000, 500u << MIN(svc[i].fails, 7)), 0);
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  svc[i].spawnms = (end.tv_sec - svc[i].started.tv_sec) * 1e3
+                   + (end.tv_nsec - svc[i].started.tv_nsec) / 1e6;
+  fprintf(stderr, "dwm: service %s started, pid %d, spawned in %.3fms\n",
+          services[i].name, (int)svc[i].pid, svc[i].spawnms);
+}
+
+void
+servicetick(int fd)
+{
+  size_t i;
+
+  for(i = 0; i < LENGTH(services); i++)
+    if(svc[i].timer == fd && svc[i].pid <= 0)
+    {
+      svc[i].restarts++;
+      servicestart(i);
+    }
 }
 
 void
@@ -3352,12 +5434,14 @@ setfullscreen(Client *c, int fullscreen)
                     PropModeReplace,
                     (unsigned char *)&netatom[NetWMFullscreen], 1);
     c->isfullscreen = 1;
+    ipcevent(IpcEvFullscreen, c, c->mon, NULL);
   }
   else if(!fullscreen && c->isfullscreen)
   {
     XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
                     PropModeReplace, (unsigned char *)0, 0);
     c->isfullscreen = 0;
+    ipcevent(IpcEvFullscreen, c, c->mon, NULL);
   }
   resizeclient(c, c->x, c->y, c->w, c->h);
   arrange(c->mon);
@@ -3409,15 +5493,200 @@ setmfact(const Arg *arg)
   arrange(selmon);
 }
 
+/* Sort the clients of m into the order the last session had them in,
+ * clients it did not know go last. */
+void
+sessionorder(Monitor *m)
+{
+  Client *c, *next, **cp, *sorted = NULL;
+
+  for(c = m->clients; c; c = next)
+  {
+    next = c->next;
+    for(cp = &sorted; *cp && sessionrank(*cp) <= sessionrank(c);
+        cp = &(*cp)->next)
+      ;
+    c->next = *cp;
+    *cp = c;
+  }
+  m->clients = sorted;
+  for(next = NULL, c = sorted; c; next = c, c = c->next)
+    c->prev = next;
+  m->clientstail = next;
+}
+
+unsigned int
+sessionrank(Client *c)
+{
+  size_t i;
+
+  for(i = 0; i < nsessrecs; i++)
+    if(sessrecs[i].win == c->win)
+      return sessrecs[i].order;
+  return UINT_MAX;
+}
+
+/* Look up the class and instance of c and the record the last session
+ * left for its window, NULL if there is none for this class and instance. */
+const SessionRecord *
+sessionfind(Client *c)
+{
+  XClassHint ch = { NULL, NULL };
+  const SessionRecord *r = NULL;
+  size_t i;
+
+  if(!nsessrecs)
+    return NULL;
+  XGetClassHint(dpy, c->win, &ch);
+  strncpy(c->class, ch.res_class ? ch.res_class : broken, sizeof c->class - 1);
+  strncpy(c->instance, ch.res_name ? ch.res_name : broken,
+          sizeof c->instance - 1);
+  if(ch.res_class)
+    XFree(ch.res_class);
+  if(ch.res_name)
+    XFree(ch.res_name);
+  for(i = 0; i < nsessrecs && !r; i++)
+    if(sessrecs[i].win == c->win
+       && !strncmp(sessrecs[i].class, c->class, sizeof r->class - 1)
+       && !strncmp(sessrecs[i].instance, c->instance, sizeof r->instance - 1))
+      r = &sessrecs[i];
+  return r;
+}
+
+/* Whether the last session had w hidden. Its window was withdrawn when that
+ * session ended, scan has to adopt it anyway. */
+int
+sessionhidden(Window w)
+{
+  Client c = { .win = w };
+  const SessionRecord *r;
+  size_t i;
+
+  /* most unmapped windows were never ours, spare them the class lookup */
+  for(i = 0; i < nsessrecs && sessrecs[i].win != w; i++)
+    ;
+  if(i == nsessrecs || !sessrecs[i].hidden)
+    return 0;
+  r = sessionfind(&c);
+  return r && r->hidden;
+}
+
+/* Give c the state the last session recorded for its window, 0 if there is
+ * none for a window of this class and instance. */
+int
+sessionrestore(Client *c)
+{
+  const SessionRecord *r;
+  Monitor *m;
+
+  if(!(r = sessionfind(c)))
+    return 0;
+  for(m = mons; m && m->num != r->mon; m = m->next)
+    ;
+  c->mon = m ? m : selmon;
+  c->tags = r->tags & TAGMASK ? r->tags & TAGMASK
+                              : c->mon->tagset[c->mon->seltags];
+  c->x = c->oldx = r->x;
+  c->y = c->oldy = r->y;
+  c->w = c->oldw = r->w;
+  c->h = c->oldh = r->h;
+  c->isfloating = r->isfloating;
+  c->forcetile = r->forcetile;
+  c->iswarppointer = r->iswarppointer;
+  c->iniposition = r->iniposition;
+  c->viewontag = r->viewontag;
+  c->borderpx = r->borderpx;
+  c->hasrulebw = r->hasrulebw;
+  if(r->hidden) /* manage leaves it unmapped */
+    setclientstate(c, IconicState);
+  return 1;
+}
+
+void
+sessionrecord(Client *c, SessionRecord *r)
+{
+  Client *i;
+
+  memset(r, 0, sizeof *r);
+  r->win = c->win;
+  r->tags = c->tags;
+  for(i = c->mon->clients; i && i != c; i = i->next)
+    r->order++;
+  r->x = c->x;
+  r->y = c->y;
+  r->w = c->w;
+  r->h = c->h;
+  r->mon = c->mon->num;
+  r->borderpx = c->borderpx;
+  r->isfloating = c->isfloating;
+  r->forcetile = c->forcetile;
+  r->iswarppointer = c->iswarppointer;
+  r->hasrulebw = c->hasrulebw;
+  r->iniposition = c->iniposition;
+  r->viewontag = c->viewontag;
+  r->hidden = HIDDEN(c);
+  strncpy(r->class, c->class, sizeof r->class - 1);
+  strncpy(r->instance, c->instance, sizeof r->instance - 1);
+}
+
+/* Journal the state of c, folding the journal into a new snapshot once
+ * it grew long. */
+void
+sessionsave(Client *c)
+{
+  SessionRecord r;
+
+  if(!c || restoring)
+    return;
+  sessionrecord(c, &r);
+  session_put(&r);
+  if(session_pending() >= 256)
+    sessionsnapshot();
+}
+
+void
+sessionsnapshot(void)
+{
+  SessionRecord *recs;
+  size_t n = 0;
+  Monitor *m;
+  Client *c;
+
+  for(m = mons; m; m = m->next)
+    for(c = m->clients; c; c = c->next)
+      n++;
+  recs = ecalloc(n ? n : 1, sizeof *recs);
+  n = 0;
+  for(m = mons; m; m = m->next)
+    for(c = m->clients; c; c = c->next)
+      sessionrecord(c, &recs[n++]);
+  session_snapshot(recs, n);
+  free(recs);
+}
+
 void
 setup(void)
 {
   int i;
   XSetWindowAttributes wa;
-  Atom utf8string;
-
+  Atom utf8string, atoms[WMLast + NetLast + 1];
+  char *names[WMLast + NetLast + 1];
+  sigset_t sigs;
+
+  /* block the signals sigread() takes before any thread is started, so
+   * none of them can be picked to run a handler */
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGCHLD);
+  sigaddset(&sigs, SIGHUP);
+  sigaddset(&sigs, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &sigs, &sigorig);
+  if((sigfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+    die("dwm: signalfd:");
   /* clean up any zombies immediately */
-  sigchld(0);
+  while(0 < waitpid(-1, NULL, WNOHANG))
+    ;
+  spawninit();
+  startmark("signals");
 
   /* init screen */
   screen = DefaultScreen(dpy);
@@ -3425,37 +5694,32 @@ setup(void)
   sh = DisplayHeight(dpy, screen);
   root = RootWindow(dpy, screen);
   xinitvisual();
-  drw = drw_create(dpy, screen, root, sw, sh, visual, depth, cmap);
-  if(!drw_fontset_create(drw, fonts, LENGTH(fonts)))
-    die("no fonts could be loaded.");
-  lrpad = drw->fonts->h;
-  bh = user_bh ? user_bh : drw->fonts->h + 2;
-  updategeom();
+  /* the bars are drawn by the render thread, see barinit() */
+  drw = drw_create(dpy, screen, root, 1, 1, visual, depth, cmap);
+  drw_atlas_init(drw, ICONSIZE, ICONSIZE, 256);
+  barinit();
+  startmark("render, fonts");
+  lrpad = render.drw->fonts->h;
+  bh = user_bh ? user_bh : render.drw->fonts->h + 2;
   sp = sidepad;
   vp = (topbar == 1) ? vertpad : -vertpad;
-
-  /* init atoms */
-  utf8string = XInternAtom(dpy, "UTF8_STRING", False);
-  wmatom[WMProtocols] = XInternAtom(dpy, "WM_PROTOCOLS", False);
-  wmatom[WMDelete] = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
-  wmatom[WMState] = XInternAtom(dpy, "WM_STATE", False);
-  wmatom[WMTakeFocus] = XInternAtom(dpy, "WM_TAKE_FOCUS", False);
-  netatom[NetActiveWindow] = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
-  netatom[NetSupported] = XInternAtom(dpy, "_NET_SUPPORTED", False);
-  netatom[NetWMName] = XInternAtom(dpy, "_NET_WM_NAME", False);
-  netatom[NetWMIcon] = XInternAtom(dpy, "_NET_WM_ICON", False);
-  netatom[NetWMState] = XInternAtom(dpy, "_NET_WM_STATE", False);
-  netatom[NetWMCheck] = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
-  netatom[NetWMFullscreen]
-      = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
-  netatom[NetWMWindowType] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
-  netatom[NetWMWindowTypeDialog]
-      = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
-  netatom[NetWMWindowTypeNotification]
-      = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_NOTIFICATION", False);
-  netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
-  netatom[NetWMWindowTypeDock]
-      = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DOCK", False);
+  if(pthread_create(&render.thread, NULL, barrun, NULL))
+    die("dwm: cannot create render thread");
+#ifdef XRANDR
+  randrinit();
+#endif /* XRANDR */
+  updategeom();
+  startmark("geometry");
+
+  /* init atoms, all in one round trip */
+  memcpy(names, wmatomnames, sizeof wmatomnames);
+  memcpy(names + WMLast, netatomnames, sizeof netatomnames);
+  names[WMLast + NetLast] = "UTF8_STRING";
+  XInternAtoms(dpy, names, LENGTH(names), False, atoms);
+  memcpy(wmatom, atoms, sizeof wmatom);
+  memcpy(netatom, atoms + WMLast, sizeof netatom);
+  utf8string = atoms[WMLast + NetLast];
+  startmark("atoms");
   /* init cursors */
   cursor[CurNormal] = drw_cur_create(drw, XC_left_ptr);
   cursor[CurResize] = drw_cur_create(drw, XC_sizing);
@@ -3465,6 +5729,21 @@ setup(void)
   scheme = ecalloc(LENGTH(colors), sizeof(Clr *));
   for(i = 0; i < LENGTH(colors); i++)
     scheme[i] = drw_scm_create(drw, colors[i], alphas[i], 3);
+  startmark("cursors, colors");
+  /* init event sources */
+  if((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    die("dwm: epoll_create1:");
+  fcntl(ConnectionNumber(dpy), F_SETFD, FD_CLOEXEC);
+  watch(ConnectionNumber(dpy), NULL);
+  watch(sigfd, sigread);
+  warminit();
+  idleinit();
+  wallinit();
+  statusinit();
+  shmstatusinit();
+  iconinit();
+  ipcinit();
+  startmark("event sources");
   /* init bars */
   updatebars();
   updatestatus();
@@ -3490,6 +5769,7 @@ setup(void)
   XSelectInput(dpy, root, wa.event_mask);
   grabkeys();
   focus(NULL);
+  startmark("bars, root");
 }
 
 void
@@ -3532,6 +5812,78 @@ showall(const Arg *arg)
   restack(selmon);
 }
 
+void
+shmstatusbell(int fd)
+{
+  char buf[64];
+
+  while(read(fd, buf, sizeof buf) > 0)
+    ;
+  if(shm.armed)
+    return;
+  timerset(shm.frame, 1000 / 60, 0);
+  shm.armed = 1;
+}
+
+/* Append the segments external producers published to text. While they
+ * keep the block busy, or one died in the middle of writing, the last
+ * consistent snapshot is shown and the frame timer tries again, backing
+ * off up to SHMSTATUS_STALE_MS after which a producer takes the lock over. */
+void
+shmstatuscompose(char *text, size_t size)
+{
+  char seg[SHMSTATUS_SEGS][SHMSTATUS_LEN];
+  size_t i, n = strlen(text);
+
+  if(!shm.block)
+    return;
+  if(shmstatus_snapshot(shm.block, seg))
+  {
+    memcpy(shm.last, seg, sizeof seg);
+    shm.retry = 0;
+  }
+  else if(!shm.armed)
+  {
+    shm.retry = shm.retry ? MIN(shm.retry * 2, SHMSTATUS_STALE_MS) : 1000 / 60;
+    timerset(shm.frame, shm.retry, 0);
+    shm.armed = 1;
+  }
+  for(i = 0; i < SHMSTATUS_SEGS && n < size; i++)
+  {
+    if(!shm.last[i][0])
+      continue;
+    n += snprintf(text + n, size - n, "%s%s", n ? statussep : "", shm.last[i]);
+  }
+}
+
+void
+shmstatusframe(int fd)
+{
+  shm.armed = 0;
+  updatestatus();
+}
+
+void
+shmstatusinit(void)
+{
+  char path[256];
+
+  if(!shmstatus)
+    return;
+  if(!(shm.block = shmstatus_map()) || !shmstatus_path(path, sizeof path, ".fifo")
+     || (mkfifo(path, 0600) < 0 && errno != EEXIST)
+     /* opened for writing as well so the fifo never reports EOF, whatever
+      * was there already must be a fifo of ours */
+     || (shm.bell = shmstatus_open(".fifo", O_RDWR | O_NONBLOCK, S_IFIFO))
+            < 0)
+  {
+    fprintf(stderr, "dwm: shared memory status unavailable\n");
+    return;
+  }
+  watch(shm.bell, shmstatusbell);
+  shm.frame = timernew(0, 0, shmstatusframe);
+}
+
 void
 showwin(Client *c)
 {
@@ -3541,6 +5893,7 @@ showwin(Client *c)
   XMapWindow(dpy, c->win);
   setclientstate(c, NormalState);
   arrange(c->mon);
+  sessionsave(c);
 }
 
 void
@@ -3564,13 +5917,34 @@ showhide(Client *c)
   }
 }
 
+/* Signals are blocked and read here instead of being handled
+ * asynchronously, so they can act on dwm's state like any other event. */
 void
-sigchld(int unused)
+sigread(int fd)
 {
-  if(signal(SIGCHLD, sigchld) == SIG_ERR)
-    die("can't install SIGCHLD handler:");
-  while(0 < waitpid(-1, NULL, WNOHANG))
-    ;
+  struct signalfd_siginfo si;
+  pid_t pid;
+
+  while(read(fd, &si, sizeof si) == sizeof si)
+    switch(si.ssi_signo)
+    {
+    case SIGCHLD:
+      while(0 < (pid = waitpid(-1, NULL, WNOHANG)))
+      {
+        servicereap(pid);
+        warmreap(pid);
+        togglereap(pid);
+        if(pid == idle.pid)
+          idle.pid = 0;
+      }
+      break;
+    case SIGHUP:
+      restart(NULL);
+      break;
+    case SIGTERM:
+      running = 0;
+      break;
+    }
 }
 
 int
@@ -3583,22 +5957,193 @@ solitary(Client *c)
 }
 
 void
-spawn(const Arg *arg)
+spawn(const Arg *arg)
+{
+  if(!warmtake(arg->v))
+    spawncmd(arg->v);
+}
+
+/* Start argv, returns its pid or -1. */
+pid_t
+spawncmd(const char *const *cmd)
+{
+  char *const *argv = (char *const *)cmd;
+  const char *path;
+  pid_t pid;
+  int err;
+
+  /* posix_spawn neither copies our page tables nor searches PATH in the
+   * child, our fds are all close-on-exec */
+  if((path = spawnpath(cmd, 0)))
+    err = posix_spawn(&pid, path, NULL, &spawnattr, argv, environ);
+  if(!path || err == ENOENT) /* not a cached command or moved since */
+    err = (path = spawnpath(cmd, 1))
+              ? posix_spawn(&pid, path, NULL, &spawnattr, argv, environ)
+              : posix_spawnp(&pid, argv[0], NULL, &spawnattr, argv, environ);
+  if(err)
+  {
+    fprintf(stderr, "dwm: spawn '%s': %s\n", argv[0], strerror(err));
+    return -1;
+  }
+  return pid;
+}
+
+void
+spawninit(void)
+{
+  sigset_t def;
+  size_t i;
+
+  sigemptyset(&def);
+  sigaddset(&def, SIGPIPE);
+  posix_spawnattr_init(&spawnattr);
+  posix_spawnattr_setflags(&spawnattr, SPAWN_DETACH | POSIX_SPAWN_SETSIGMASK
+                                           | POSIX_SPAWN_SETSIGDEF);
+  posix_spawnattr_setsigmask(&spawnattr, &sigorig);
+  posix_spawnattr_setsigdefault(&spawnattr, &def);
+  for(i = 0; i < LENGTH(keys); i++)
+    if(keys[i].func == spawn)
+      spawnpaths[nspawnpaths++].argv = keys[i].arg.v;
+  for(i = 0; i < LENGTH(buttons); i++)
+    if(buttons[i].func == spawn)
+      spawnpaths[nspawnpaths++].argv = buttons[i].arg.v;
+  for(i = 0; i < nspawnpaths; i++)
+    spawnpath(spawnpaths[i].argv, 1);
+}
+
+/* The executable argv runs, if argv is one of the cached commands. It is
+ * looked up again if refresh is set or PATH changed. */
+const char *
+spawnpath(const char *const *argv, int refresh)
+{
+  const char *env = getenv("PATH") ? getenv("PATH") : "/bin:/usr/bin";
+  const char *p, *e;
+  char buf[PATH_MAX];
+  size_t i;
+
+  if(!spawnenvpath || strcmp(spawnenvpath, env))
+  {
+    free(spawnenvpath);
+    spawnenvpath = strdup(env);
+    for(i = 0; i < nspawnpaths; i++)
+    {
+      free(spawnpaths[i].path);
+      spawnpaths[i].path = NULL;
+    }
+    refresh = 1;
+  }
+  for(i = 0; i < nspawnpaths && spawnpaths[i].argv != argv; i++)
+    ;
+  if(i == nspawnpaths)
+    return NULL;
+  if(spawnpaths[i].path && !refresh)
+    return spawnpaths[i].path;
+  free(spawnpaths[i].path);
+  spawnpaths[i].path = NULL;
+  if(strchr(argv[0], '/'))
+    return spawnpaths[i].path = strdup(argv[0]);
+  for(p = env; *p; p = *e ? e + 1 : e)
+  {
+    e = p + strcspn(p, ":");
+    if(e == p) /* an empty entry is the working directory */
+      snprintf(buf, sizeof buf, "./%s", argv[0]);
+    else
+      snprintf(buf, sizeof buf, "%.*s/%s", (int)(e - p), p, argv[0]);
+    if(!access(buf, X_OK))
+      return spawnpaths[i].path = strdup(buf);
+  }
+  return NULL;
+}
+
+void
+spiral(Monitor *mon)
+{
+  fibonacci(mon, 0);
+}
+
+/* With -T, print how long phase took and the time since startmark(NULL)
+ * was called. Called from the render thread too. */
+void
+startmark(const char *phase)
+{
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static struct timespec start, last;
+  struct timespec now;
+
+  if(!starttiming)
+    return;
+  pthread_mutex_lock(&lock);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if(!phase)
+    start = now;
+  else
+    fprintf(stderr, "dwm: %-16s %8.3f ms %8.3f ms\n", phase,
+            (now.tv_sec - last.tv_sec) * 1e3
+                + (now.tv_nsec - last.tv_nsec) / 1e6,
+            (now.tv_sec - start.tv_sec) * 1e3
+                + (now.tv_nsec - start.tv_nsec) / 1e6);
+  last = now;
+  pthread_mutex_unlock(&lock);
+}
+
+void
+statuscompose(char *text, size_t size)
+{
+  size_t i, n = 0;
+
+  text[0] = '\0';
+  for(i = 0; i < LENGTH(statusmodules); i++)
+  {
+    if(!statusmods[i].text[0])
+      continue;
+    n += snprintf(text + n, size - MIN(n, size), "%s%s", n ? statussep : "",
+                  statusmods[i].text);
+    if(n >= size)
+      break;
+  }
+}
+
+void
+statusinit(void)
 {
-  if(fork() == 0)
+  size_t i;
+
+  if(!builtinstatus)
+    return;
+  for(i = 0; i < LENGTH(statusmodules); i++)
   {
-    if(dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("dwm: execvp '%s' failed:", ((char **)arg->v)[0]);
+    statusmods[i].fd = timernew(
+        statusmodules[i].interval ? statusmodules[i].interval : 1000, 1,
+        statustick);
+    statusrun(i);
   }
 }
 
+/* Refresh module i, returns 1 if its text changed. */
+int
+statusrun(size_t i)
+{
+  char value[64], text[sizeof statusmods[i].text];
+
+  if(!statusmodules[i].func(value, sizeof value, statusmodules[i].arg,
+                            &statusmods[i].st))
+    text[0] = '\0';
+  else
+    snprintf(text, sizeof text, statusmodules[i].fmt, value);
+  if(!strcmp(text, statusmods[i].text))
+    return 0;
+  strcpy(statusmods[i].text, text);
+  return 1;
+}
+
 void
-spiral(Monitor *mon)
+statustick(int fd)
 {
-  fibonacci(mon, 0);
+  size_t i;
+
+  for(i = 0; i < LENGTH(statusmodules); i++)
+    if(statusmods[i].fd == fd && statusrun(i))
+      updatestatus();
 }
 
 void
@@ -3614,6 +6159,7 @@ tag(const Arg *arg)
   if(selmon->sel && arg->ui & TAGMASK)
   {
     selmon->sel->tags = arg->ui & TAGMASK;
+    sessionsave(selmon->sel);
     focus(NULL);
     arrange(selmon);
     if(viewontag && ((arg->ui & TAGMASK) != TAGMASK))
@@ -3703,6 +6249,35 @@ tile(Monitor *m)
     }
 }
 
+/* Call fn from the main loop ms milliseconds from now, and every ms after
+ * that if periodic. A timer created with ms 0 waits for timerset(). */
+int
+timernew(unsigned int ms, int periodic, void (*fn)(int fd))
+{
+  int fd;
+
+  if((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+    die("dwm: timerfd:");
+  watch(fd, fn);
+  watches->timer = 1;
+  timerset(fd, ms, periodic);
+  return fd;
+}
+
+/* Rearm the timer fd, or disarm it if ms is 0. */
+void
+timerset(int fd, unsigned int ms, int periodic)
+{
+  struct itimerspec its = { 0 };
+
+  its.it_value.tv_sec = ms / 1000;
+  its.it_value.tv_nsec = (ms % 1000) * 1000000;
+  if(periodic)
+    its.it_interval = its.it_value;
+  if(timerfd_settime(fd, 0, &its, NULL) < 0)
+    die("dwm: timerfd_settime:");
+}
+
 void
 togglebar(const Arg *arg)
 {
@@ -3740,6 +6315,7 @@ togglefloating(const Arg *arg)
   initposition(c);
   arrange(m);
   warppointer(c);
+  sessionsave(c);
 }
 
 void
@@ -3764,6 +6340,16 @@ togglelayer(const Arg *arg)
   arrange(selmon);
 }
 
+void
+togglereap(pid_t pid)
+{
+  size_t i;
+
+  for(i = 0; i < LENGTH(toggles); i++)
+    if(toggled[i].pid == pid)
+      toggled[i].pid = 0;
+}
+
 void
 togglermaster(const Arg *arg)
 {
@@ -3786,6 +6372,7 @@ toggletag(const Arg *arg)
   if(newtags)
   {
     selmon->sel->tags = newtags;
+    sessionsave(selmon->sel);
     focus(NULL);
     arrange(selmon);
   }
@@ -3824,17 +6411,31 @@ toggleview(const Arg *arg)
         = selmon->pertag->ltidxs[selmon->pertag->curtag][selmon->sellt ^ 1];
     focus(NULL);
     arrange(selmon);
+    ipcevent(IpcEvTag, NULL, selmon, NULL);
   }
 }
 
 void
 freeicon(Client *c)
 {
-  if(c->icon)
+  Icon **ip;
+
+  if(!c->icon)
+    return;
+  if(--c->icon->refs == 0)
   {
-    XRenderFreePicture(dpy, c->icon);
-    c->icon = None;
+    for(ip = &icons; *ip != c->icon; ip = &(*ip)->next)
+      ;
+    *ip = c->icon->next;
+    /* frames already posted may still draw it */
+    if(!(deadicons = realloc(deadicons, (ndeadicons + 1) * sizeof *deadicons)))
+      die("dwm: realloc:");
+    deadicons[ndeadicons].img = c->icon->img;
+    deadicons[ndeadicons++].head = render.head;
+    free(c->icon);
+    iconrelease();
   }
+  c->icon = NULL;
 }
 
 void
@@ -3853,6 +6454,19 @@ unfocus(Client *c, int setfocus)
     XLowerWindow(dpy, c->win);
 }
 
+/* Map hidden clients again before quitting, no one else would map them. */
+void
+unhideall(void)
+{
+  Monitor *m;
+  Client *c;
+
+  for(m = mons; m; m = m->next)
+    for(c = m->stack; c; c = c->next)
+      if(HIDDEN(c))
+        showwin(c);
+}
+
 void
 unmanage(Client *c, int destroyed)
 {
@@ -3864,6 +6478,8 @@ unmanage(Client *c, int destroyed)
   char oldname[255];
   strncpy(oldname, c->name, sizeof(oldname) - 1);
   oldname[sizeof(oldname) - 1] = '\0';
+  ipcevent(IpcEvUnmanage, c, m, NULL);
+  session_del(c->win);
 
   detach(c);
   detachstack(c);
@@ -3943,6 +6559,20 @@ updatebars(void)
   }
 }
 
+void
+unwatch(int fd)
+{
+  Watch *w;
+
+  for(w = watches; w; w = w->next)
+    if(w->fd == fd && !w->dead)
+    {
+      epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+      w->dead = 1;
+      return;
+    }
+}
+
 void
 updatebarpos(Monitor *m)
 {
@@ -3964,6 +6594,11 @@ updateclientlist(void)
   Client *c;
   Monitor *m;
 
+  if(batching)
+  {
+    clientlistdirty = 1;
+    return;
+  }
   XDeleteProperty(dpy, root, netatom[NetClientList]);
   for(m = mons; m; m = m->next)
     for(c = m->clients; c; c = c->next)
@@ -3976,11 +6611,15 @@ updategeom(void)
 {
   int dirty = 0;
 
+#ifdef XRANDR
+  if(randrevent >= 0)
+    dirty = randrgeom();
+  else
+#endif /* XRANDR */
 #ifdef XINERAMA
   if(XineramaIsActive(dpy))
   {
     int i, j, n, nn;
-    Client *c;
     Monitor *m;
     XineramaScreenInfo *info = XineramaQueryScreens(dpy, &nn);
     XineramaScreenInfo *unique = NULL;
@@ -4009,7 +6648,7 @@ updategeom(void)
       if(i >= n || unique[i].x_org != m->mx || unique[i].y_org != m->my
          || unique[i].width != m->mw || unique[i].height != m->mh)
       {
-        dirty = 1;
+        m->moved = dirty = 1;
         m->num = i;
         m->mx = m->wx = unique[i].x_org;
         m->my = m->wy = unique[i].y_org;
@@ -4022,34 +6661,9 @@ updategeom(void)
     {
       for(m = mons; m && m->next; m = m->next)
         ;
-      while((c = m->clients))
-      {
+      if(m->clients)
         dirty = 1;
-        m->clients = c->next;
-        detachstack(c);
-        c->mon = mons;
-        switch(attachdirection)
-        {
-        case 1:
-          attachabove(c);
-          break;
-        case 2:
-          attachaside(c);
-          break;
-        case 3:
-          attachbelow(c);
-          break;
-        case 4:
-          attachbottom(c);
-          break;
-        case 5:
-          attachtop(c);
-          break;
-        default:
-          attach(c);
-        }
-        attachstack(c);
-      }
+      monmigrate(m, mons);
       if(m == selmon)
         selmon = mons;
       cleanupmon(m);
@@ -4063,7 +6677,7 @@ updategeom(void)
       mons = createmon();
     if(mons->mw != sw || mons->mh != sh)
     {
-      dirty = 1;
+      mons->moved = dirty = 1;
       mons->mw = mons->ww = sw;
       mons->mh = mons->wh = sh;
       updatebarpos(mons);
@@ -4155,10 +6769,20 @@ updatesizehints(Client *c)
 void
 updatestatus(void)
 {
-  if(!gettextprop(root, XA_WM_NAME, stext, sizeof(stext)))
-    strcpy(stext,
+  char text[sizeof stext];
+
+  if(builtinstatus)
+    statuscompose(text, sizeof text);
+  else if(!gettextprop(root, XA_WM_NAME, text, sizeof(text)))
+    strcpy(text,
            ""); // no shining of dwm version thru panel, when transparent
+  shmstatuscompose(text, sizeof text);
+  /* only bother the renderer if the text actually changed */
+  if(!strcmp(text, stext))
+    return;
+  strcpy(stext, text);
   drawbar(selmon);
+  ipcevent(IpcEvStatus, NULL, NULL, stext);
 }
 
 void
@@ -4168,13 +6792,14 @@ updatetitle(Client *c)
     gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
   if(c->name[0] == '\0') /* hack to mark broken clients */
     strcpy(c->name, broken);
+  ipcevent(IpcEvTitle, c, c->mon, NULL);
 }
 
+/* Icons are only drawn for the selected client, so defer the fetch. */
 void
 updateicon(Client *c)
 {
-  freeicon(c);
-  c->icon = geticonprop(c->win, &c->icw, &c->ich);
+  c->icondirty = 1;
 }
 
 void
@@ -4259,6 +6884,7 @@ view(const Arg *arg)
     XRaiseWindow(dpy, selmon->sel->win);
   }
   arrange(selmon);
+  ipcevent(IpcEvTag, NULL, selmon, NULL);
 }
 
 void
@@ -4334,6 +6960,505 @@ wintomon(Window w)
   return selmon;
 }
 
+void
+watch(int fd, void (*fn)(int fd))
+{
+  Watch *w = ecalloc(1, sizeof(Watch));
+  struct epoll_event ev = { .events = EPOLLIN, .data.ptr = w };
+
+  w->fd = fd;
+  w->fn = fn;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    die("dwm: epoll_ctl:");
+  w->next = watches;
+  watches = w;
+}
+
+void
+watchout(int fd, int on)
+{
+  Watch *w;
+  struct epoll_event ev = { .events = EPOLLIN | (on ? EPOLLOUT : 0) };
+
+  for(w = watches; w && w->fd != fd; w = w->next)
+    ;
+  if(!w)
+    return;
+  ev.data.ptr = w;
+  epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/* Free watches removed while events for them may still be pending. */
+void
+watchreap(void)
+{
+  Watch **wp, *w;
+
+  for(wp = &watches; (w = *wp);)
+  {
+    if(w->dead)
+    {
+      *wp = w->next;
+      free(w);
+    }
+    else
+      wp = &w->next;
+  }
+}
+
+void
+walldone(int fd)
+{
+  uint64_t n;
+
+  if(read(fd, &n, sizeof n) == sizeof n && wall.stale)
+    wallnext();
+}
+
+/* The monitors changed, what was scaled for the old ones is useless. */
+void
+wallgeom(void)
+{
+  Monitor *m;
+
+  if(!wall.dpy)
+    return;
+  pthread_mutex_lock(&wall.lock);
+  wall.gen++;
+  if(wall.ready)
+    XFreePixmap(dpy, wall.ready);
+  wall.ready = None;
+  wall.w = sw;
+  wall.h = sh;
+  for(wall.nmon = 0, m = mons; m && wall.nmon < LENGTH(wall.mon);
+      m = m->next, wall.nmon++)
+  {
+    wall.mon[wall.nmon].x = m->mx;
+    wall.mon[wall.nmon].y = m->my;
+    wall.mon[wall.nmon].width = m->mw;
+    wall.mon[wall.nmon].height = m->mh;
+  }
+  wall.stale = 1;
+  pthread_cond_signal(&wall.wake);
+  pthread_mutex_unlock(&wall.lock);
+}
+
+void
+wallinit(void)
+{
+  char *wallatomnames[] = { "_XROOTPMAP_ID", "ESETROOT_PMAP_ID" };
+  Atom wallatoms[2];
+
+  if(!wallinterval)
+    return;
+  if(!(wall.dpy = XOpenDisplay(NULL))
+     || (wall.donefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+  {
+    fputs("dwm: wallpaper rotation unavailable\n", stderr);
+    if(wall.dpy)
+      XCloseDisplay(wall.dpy);
+    wall.dpy = NULL;
+    return;
+  }
+  fcntl(ConnectionNumber(wall.dpy), F_SETFD, FD_CLOEXEC);
+  XSetCloseDownMode(wall.dpy, RetainPermanent);
+  XInternAtoms(dpy, wallatomnames, 2, False, wallatoms);
+  wall.rootpmap = wallatoms[0];
+  wall.esetroot = wallatoms[1];
+  watch(wall.donefd, walldone);
+  wall.timer = timernew(wallinterval * 1000, 1, walltick);
+  wallgeom();
+  if(pthread_create(&wall.thread, NULL, wallrun, NULL))
+    die("dwm: pthread_create:");
+}
+
+/* Put the next ready wallpaper on the root window. */
+void
+wallnext(void)
+{
+  Atom type;
+  int format;
+  unsigned long n, extra;
+  unsigned char *p = NULL, *q = NULL;
+  Pixmap pm;
+
+  pthread_mutex_lock(&wall.lock);
+  if(!(pm = wall.ready))
+  {
+    pthread_mutex_unlock(&wall.lock);
+    return;
+  }
+  wall.ready = None;
+  wall.stale = 0;
+  pthread_cond_signal(&wall.wake);
+  pthread_mutex_unlock(&wall.lock);
+  /* like other setters, free what a previous one left retained */
+  if(!wall.shown
+     && XGetWindowProperty(dpy, root, wall.rootpmap, 0, 1, False, XA_PIXMAP,
+                           &type, &format, &n, &extra, &p)
+            == Success
+     && n
+     && XGetWindowProperty(dpy, root, wall.esetroot, 0, 1, False, XA_PIXMAP,
+                           &type, &format, &n, &extra, &q)
+            == Success
+     && n && *(Pixmap *)p == *(Pixmap *)q)
+    XKillClient(dpy, *(Pixmap *)p);
+  if(p)
+    XFree(p);
+  if(q)
+    XFree(q);
+  XChangeProperty(dpy, root, wall.rootpmap, XA_PIXMAP, 32, PropModeReplace,
+                  (unsigned char *)&pm, 1);
+  XChangeProperty(dpy, root, wall.esetroot, XA_PIXMAP, 32, PropModeReplace,
+                  (unsigned char *)&pm, 1);
+  XSetWindowBackgroundPixmap(dpy, root, pm);
+  XClearWindow(dpy, root);
+  if(wall.shown)
+    XFreePixmap(dpy, wall.shown);
+  wall.shown = pm;
+}
+
+void
+wallquit(void)
+{
+  if(!wall.dpy)
+    return;
+  pthread_mutex_lock(&wall.lock);
+  wall.quit = 1;
+  pthread_cond_signal(&wall.wake);
+  pthread_mutex_unlock(&wall.lock);
+  pthread_join(wall.thread, NULL);
+  if(wall.ready)
+    XFreePixmap(wall.dpy, wall.ready);
+  wall.ready = None;
+  /* the one shown is retained for the next setter to free */
+  XCloseDisplay(wall.dpy);
+  wall.dpy = NULL;
+}
+
+/* Draw the next images of files, one per monitor, filling each and
+ * cropping what sticks out like feh --bg-fill. */
+Pixmap
+wallrender(char **files, size_t nfiles, size_t *next, unsigned int *seed,
+           const XRectangle *mon, int nmon, int w, int h)
+{
+  int scr = DefaultScreen(wall.dpy);
+  Imlib_Image img;
+  Pixmap pm;
+  GC gc;
+  char *t;
+  size_t tries, j, k;
+  int i, iw, ih, cw, ch;
+
+  pm = XCreatePixmap(wall.dpy, RootWindow(wall.dpy, scr), w, h,
+                     DefaultDepth(wall.dpy, scr));
+  gc = XCreateGC(wall.dpy, pm, 0, NULL);
+  XSetForeground(wall.dpy, gc, BlackPixel(wall.dpy, scr));
+  XFillRectangle(wall.dpy, pm, gc, 0, 0, w, h);
+  XFreeGC(wall.dpy, gc);
+  imlib_context_set_drawable(pm);
+  for(i = 0; i < nmon; i++)
+  {
+    for(img = NULL, tries = 0; !img && tries < nfiles; tries++)
+    {
+      if(!*next) /* went through all of them, shuffle again */
+        for(j = nfiles - 1; j > 0; j--)
+        {
+          k = rand_r(seed) % (j + 1);
+          t = files[j];
+          files[j] = files[k];
+          files[k] = t;
+        }
+      img = imlib_load_image(files[*next]);
+      *next = (*next + 1) % nfiles;
+    }
+    if(!img)
+      break;
+    imlib_context_set_image(img);
+    iw = imlib_image_get_width();
+    ih = imlib_image_get_height();
+    if((long)iw * mon[i].height > (long)ih * mon[i].width)
+    {
+      ch = ih;
+      cw = (long)ih * mon[i].width / mon[i].height;
+    }
+    else
+    {
+      cw = iw;
+      ch = (long)iw * mon[i].height / mon[i].width;
+    }
+    imlib_render_image_part_on_drawable_at_size((iw - cw) / 2, (ih - ch) / 2,
+                                                cw, ch, mon[i].x, mon[i].y,
+                                                mon[i].width, mon[i].height);
+    imlib_free_image();
+  }
+  /* it has to exist before the main connection refers to it */
+  XSync(wall.dpy, False);
+  return pm;
+}
+
+void *
+wallrun(void *arg)
+{
+  XRectangle mon[LENGTH(wall.mon)];
+  char dir[PATH_MAX], **files = NULL;
+  size_t nfiles = 0, next = 0;
+  unsigned int gen, seed = time(NULL) ^ getpid();
+  int scr = DefaultScreen(wall.dpy), nmon, w, h;
+  const char *home = getenv("HOME");
+  Pixmap pm;
+
+  if(!strncmp(wallpaperdir, "~/", 2) && home)
+    snprintf(dir, sizeof dir, "%s%s", home, wallpaperdir + 1);
+  else
+    snprintf(dir, sizeof dir, "%s", wallpaperdir);
+  wallscan(dir, 0, &files, &nfiles);
+  if(!nfiles)
+  {
+    fprintf(stderr, "dwm: no wallpapers in %s\n", dir);
+    return NULL;
+  }
+  imlib_context_set_display(wall.dpy);
+  imlib_context_set_visual(DefaultVisual(wall.dpy, scr));
+  imlib_context_set_colormap(DefaultColormap(wall.dpy, scr));
+  imlib_context_set_anti_alias(1);
+  for(;;)
+  {
+    pthread_mutex_lock(&wall.lock);
+    while(!wall.quit && wall.ready)
+      pthread_cond_wait(&wall.wake, &wall.lock);
+    if(wall.quit)
+    {
+      pthread_mutex_unlock(&wall.lock);
+      break;
+    }
+    gen = wall.gen;
+    w = wall.w;
+    h = wall.h;
+    nmon = wall.nmon;
+    memcpy(mon, wall.mon, sizeof mon);
+    pthread_mutex_unlock(&wall.lock);
+    pm = wallrender(files, nfiles, &next, &seed, mon, nmon, w, h);
+    pthread_mutex_lock(&wall.lock);
+    if(gen == wall.gen && !wall.ready)
+    {
+      wall.ready = pm;
+      eventfd_write(wall.donefd, 1);
+    }
+    else /* scaled for monitors that are gone */
+      XFreePixmap(wall.dpy, pm);
+    pthread_mutex_unlock(&wall.lock);
+  }
+  while(nfiles)
+    free(files[--nfiles]);
+  free(files);
+  return NULL;
+}
+
+/* Collect the images below dir, symlinked directories are followed a
+ * few levels deep at most. */
+void
+wallscan(const char *dir, int depth, char ***files, size_t *n)
+{
+  static const char *exts[] = { ".png", ".jpg", ".jpeg" };
+  char path[PATH_MAX];
+  struct dirent *de;
+  struct stat st;
+  const char *ext;
+  size_t i;
+  DIR *d;
+
+  if(depth > 8 || !(d = opendir(dir)))
+    return;
+  while((de = readdir(d)))
+  {
+    if(de->d_name[0] == '.'
+       || snprintf(path, sizeof path, "%s/%s", dir, de->d_name)
+              >= (int)sizeof path
+       || stat(path, &st) < 0)
+      continue;
+    if(S_ISDIR(st.st_mode))
+    {
+      wallscan(path, depth + 1, files, n);
+      continue;
+    }
+    if(!S_ISREG(st.st_mode) || !(ext = strrchr(de->d_name, '.')))
+      continue;
+    for(i = 0; i < LENGTH(exts) && strcasecmp(ext, exts[i]); i++)
+      ;
+    if(i == LENGTH(exts))
+      continue;
+    if(!(*n & (*n + 1))) /* grow at powers of two */
+      *files = realloc(*files, (*n + 1) * 2 * sizeof **files);
+    if(!*files)
+      die("dwm: realloc:");
+    (*files)[(*n)++] = strdup(path);
+  }
+  closedir(d);
+}
+
+void
+walltick(int fd)
+{
+  wallnext();
+}
+
+/* Take w as a spare if one of our spares' processes asked to map it. */
+int
+warmadopt(Window w)
+{
+  unsigned char *p = NULL;
+  unsigned long n, extra;
+  Atom real;
+  int format;
+  pid_t pid = 0;
+  size_t i;
+  unsigned int j;
+
+  for(i = 0; i < LENGTH(warmcmds); i++)
+    for(j = 0; j < warm[i].n; j++)
+      if(!warm[i].spare[j].win)
+        goto pending;
+  return 0;
+pending:
+  if(XGetWindowProperty(dpy, w, netatom[NetWMPid], 0L, 1L, False,
+                        XA_CARDINAL, &real, &format, &n, &extra, &p)
+         == Success
+     && n && format == 32)
+    pid = *(unsigned long *)p;
+  if(p)
+    XFree(p);
+  for(i = 0; i < LENGTH(warmcmds); i++)
+    for(j = 0; j < warm[i].n; j++)
+      if(warm[i].spare[j].pid == pid && !warm[i].spare[j].win)
+      {
+        warm[i].spare[j].win = w;
+        return 1;
+      }
+  return 0;
+}
+
+/* A spare's window went away, forget it. */
+void
+warmdrop(Window w)
+{
+  size_t i;
+  unsigned int j;
+
+  for(i = 0; i < LENGTH(warmcmds); i++)
+    for(j = 0; j < warm[i].n; j++)
+      if(warm[i].spare[j].win == w)
+      {
+        warm[i].spare[j] = warm[i].spare[--warm[i].n];
+        return;
+      }
+}
+
+/* Top the pools up to what their recent use asks for. */
+void
+warmfill(int fd)
+{
+  unsigned int want;
+  size_t i;
+  pid_t pid;
+
+  for(i = 0; i < LENGTH(warmcmds); i++)
+  {
+    want = MIN(MIN(warmcmds[i].max, LENGTH(warm[i].spare)),
+               1 + (unsigned int)warmheat(i));
+    while(warm[i].n < want && (pid = spawncmd(warmcmds[i].cmd)) > 0)
+    {
+      warm[i].spare[warm[i].n].pid = pid;
+      warm[i].spare[warm[i].n++].win = None;
+    }
+  }
+}
+
+double
+warmheat(size_t i)
+{
+  struct timespec now;
+  double idle;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  idle = (now.tv_sec - warm[i].last.tv_sec)
+         + (now.tv_nsec - warm[i].last.tv_nsec) / 1e9;
+  return MAX(0, warm[i].heat - idle / 60);
+}
+
+void
+warminit(void)
+{
+  if(!LENGTH(warmcmds))
+    return;
+  /* the first spares are started once the session has settled */
+  warmtimer = timernew(1000, 0, warmfill);
+}
+
+void
+warmquit(void)
+{
+  size_t i;
+  unsigned int j;
+
+  for(i = 0; i < LENGTH(warmcmds); i++)
+    for(j = 0; j < warm[i].n; j++)
+      kill(warm[i].spare[j].pid, SIGTERM);
+}
+
+/* A spare exited. It is not replaced until its command is used, so one
+ * that keeps failing cannot keep us busy. */
+void
+warmreap(pid_t pid)
+{
+  size_t i;
+  unsigned int j;
+
+  for(i = 0; i < LENGTH(warmcmds); i++)
+    for(j = 0; j < warm[i].n; j++)
+      if(warm[i].spare[j].pid == pid)
+      {
+        warm[i].spare[j] = warm[i].spare[--warm[i].n];
+        return;
+      }
+}
+
+/* Manage a ready spare of cmd as if it had just been launched. Returns 0
+ * if cmd has no pool or none of its spares is ready. */
+int
+warmtake(const char *const *cmd)
+{
+  XWindowAttributes wa;
+  Window w;
+  size_t i;
+  unsigned int j;
+
+  for(i = 0; i < LENGTH(warmcmds) && warmcmds[i].cmd != cmd; i++)
+    ;
+  if(i == LENGTH(warmcmds))
+    return 0;
+  warm[i].heat = warmheat(i) + 1;
+  clock_gettime(CLOCK_MONOTONIC, &warm[i].last);
+  /* replace it once the new window had its time to draw */
+  timerset(warmtimer, 250, 0);
+  for(j = 0; j < warm[i].n;)
+  {
+    if(!(w = warm[i].spare[j].win))
+    {
+      j++;
+      continue;
+    }
+    /* its process is no spare anymore */
+    warm[i].spare[j] = warm[i].spare[--warm[i].n];
+    if(XGetWindowAttributes(dpy, w, &wa) && !wintoclient(w))
+    {
+      manage(w, &wa);
+      return 1;
+    }
+  }
+  return 0;
+}
+
 void
 warppointer(Client *c)
 {
@@ -4350,6 +7475,10 @@ warppointer(Client *c)
 int
 xerror(Display *dpy, XErrorEvent *ee)
 {
+  /* the render and icon connections use ids owned by the main connection,
+   * which may be gone by the time a queued frame or fetch is served */
+  if(dpy == render.dpy || dpy == iconwork.dpy)
+    return 0;
   if(ee->error_code == BadWindow
      || (ee->request_code == X_SetInputFocus && ee->error_code == BadMatch)
      || (ee->request_code == X_PolyText8 && ee->error_code == BadDrawable)
@@ -4433,25 +7562,49 @@ zoom(const Arg *arg)
 int
 main(int argc, char *argv[])
 {
-  if(argc == 2 && !strcmp("-v", argv[1]))
-    die("dwm-" VERSION);
-  else if(argc != 1)
-    die("usage: dwm [-v]");
+  int i, fd = -1;
+
+  for(i = 1; i < argc; i++)
+    if(!strcmp("-v", argv[i]))
+      die("dwm-" VERSION);
+    else if(!strcmp("-T", argv[i]))
+      starttiming = 1;
+    else if(!strcmp("-r", argv[i]) && i + 1 < argc)
+      fd = atoi(argv[++i]); /* restarted in place, see restart() */
+    else
+      die("usage: dwm [-vT]");
+  startmark(NULL);
+  XInitThreads();
   if(!setlocale(LC_CTYPE, "") || !XSupportsLocale())
     fputs("warning: no locale support\n", stderr);
   if(!(dpy = XOpenDisplay(NULL)))
     die("dwm: cannot open display");
+  startmark("connect");
   checkotherwm();
+  startmark("other wm check");
   setup();
 #ifdef __OpenBSD__
   if(pledge("stdio rpath proc exec", NULL) == -1)
     die("pledge");
 #endif /* __OpenBSD__ */
+  if(fd >= 0)
+    restartload(fd);
   scan();
-  runautostart();
-  runpanel();
+  startmark("scan");
+  if(fd >= 0)
+    restartfocus(); /* autostart and the panel survived the restart */
+  else
+  {
+    runautostart();
+    runpanel();
+  }
+  startmark("autostart");
+  serviceinit();
+  startmark("services");
   run();
   cleanup();
   XCloseDisplay(dpy);
+  if(restartfd >= 0)
+    restartexec(argv[0]);
   return EXIT_SUCCESS;
 }
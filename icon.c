@@ -0,0 +1,330 @@
+/* See LICENSE file for copyright and license details. */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && defined(__LP64__) && defined(__GNUC__)
+#define ICON_X86 1
+#include <immintrin.h>
+#endif
+
+#include "icon.h"
+
+/* Sum the premultiplied channels of n source pixels into acc[b, g, r, a].
+ * Premultiplying matches the scalar (c * a) >> 8 so all kernels agree. */
+typedef void (*RowSum)(uint32_t acc[4], const unsigned long *px, unsigned int n);
+
+static void
+rowsum_c(uint32_t acc[4], const unsigned long *px, unsigned int n)
+{
+    uint32_t p, a;
+    unsigned int i;
+
+    for(i = 0; i < n; i++) {
+        p = (uint32_t)px[i];
+        a = p >> 24;
+        acc[0] += ((p & 0xff) * a) >> 8;
+        acc[1] += (((p >> 8) & 0xff) * a) >> 8;
+        acc[2] += (((p >> 16) & 0xff) * a) >> 8;
+        acc[3] += a;
+    }
+}
+
+#ifdef ICON_X86
+/* Premultiply the pixels held as 16 bit channels in v, keeping alpha. */
+#define PREMUL_SSE2(v, amask)                                               \
+    _mm_or_si128(                                                           \
+        _mm_andnot_si128(amask,                                             \
+            _mm_srli_epi16(_mm_mullo_epi16(v,                               \
+                _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xff), 0xff)),   \
+                8)),                                                        \
+        _mm_and_si128(amask, v))
+
+static void
+rowsum_sse2(uint32_t acc[4], const unsigned long *px, unsigned int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    __m128i sum = _mm_loadu_si128((const __m128i *)acc), v;
+    unsigned int i = 0;
+
+    for(; i + 2 <= n; i += 2) {
+        /* two 64 bit words, pixel in the low half of each */
+        v = _mm_loadu_si128((const __m128i *)(px + i));
+        v = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0));
+        v = _mm_unpacklo_epi8(v, zero);
+        v = PREMUL_SSE2(v, amask);
+        sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(v, zero));
+        sum = _mm_add_epi32(sum, _mm_unpackhi_epi16(v, zero));
+    }
+    if(i < n) {
+        v = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)(uint32_t)px[i]), zero);
+        v = PREMUL_SSE2(v, amask);
+        sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(v, zero));
+    }
+    _mm_storeu_si128((__m128i *)acc, sum);
+}
+
+__attribute__((target("avx2"))) static void
+rowsum_avx2(uint32_t acc[4], const unsigned long *px, unsigned int n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m256i amask = _mm256_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1,
+                                            0, 0, 0, -1, 0, 0, 0, -1);
+    __m256i sum = zero, v, a;
+    __m128i s;
+    unsigned int i = 0;
+
+    for(; i + 4 <= n; i += 4) {
+        /* four 64 bit words packed down to four pixels */
+        v = _mm256_loadu_si256((const __m256i *)(px + i));
+        v = _mm256_permutevar8x32_epi32(v, pack);
+        v = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v));
+        a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0xff), 0xff);
+        v = _mm256_or_si256(
+            _mm256_andnot_si256(amask,
+                _mm256_srli_epi16(_mm256_mullo_epi16(v, a), 8)),
+            _mm256_and_si256(amask, v));
+        sum = _mm256_add_epi32(sum, _mm256_unpacklo_epi16(v, zero));
+        sum = _mm256_add_epi32(sum, _mm256_unpackhi_epi16(v, zero));
+    }
+    s = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                      _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i *)acc));
+    _mm_storeu_si128((__m128i *)acc, s);
+    if(i < n)
+        rowsum_sse2(acc, px + i, n - i);
+}
+#endif /* ICON_X86 */
+
+static RowSum rowsum;
+static const char *rowsumname;
+
+static void
+dispatch(void)
+{
+    rowsum = rowsum_c;
+    rowsumname = "scalar";
+#ifdef ICON_X86
+    rowsum = rowsum_sse2;
+    rowsumname = "sse2";
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        rowsum = rowsum_avx2;
+        rowsumname = "avx2";
+    }
+#endif
+}
+
+const char *
+icon_kernel(void)
+{
+    if(!rowsum)
+        dispatch();
+    return rowsumname;
+}
+
+void
+icon_scale(uint32_t *dst, unsigned int dw, unsigned int dh,
+           const unsigned long *src, unsigned int sw, unsigned int sh)
+{
+    unsigned int dx, dy, x0, x1, y0, y1, y, n;
+    uint32_t acc[4];
+
+    if(!rowsum)
+        dispatch();
+    for(dy = 0; dy < dh; dy++) {
+        y0 = (unsigned long)dy * sh / dh;
+        y1 = (unsigned long)(dy + 1) * sh / dh;
+        if(y1 <= y0)
+            y1 = y0 + 1;
+        for(dx = 0; dx < dw; dx++) {
+            /* box covering this destination pixel, a single source
+             * pixel when upscaling */
+            x0 = (unsigned long)dx * sw / dw;
+            x1 = (unsigned long)(dx + 1) * sw / dw;
+            if(x1 <= x0)
+                x1 = x0 + 1;
+            memset(acc, 0, sizeof acc);
+            for(y = y0; y < y1; y++)
+                rowsum(acc, src + (unsigned long)y * sw + x0, x1 - x0);
+            n = (x1 - x0) * (y1 - y0);
+            *dst++ = (acc[0] + n / 2) / n
+                     | ((acc[1] + n / 2) / n) << 8
+                     | ((acc[2] + n / 2) / n) << 16
+                     | ((acc[3] + n / 2) / n) << 24;
+        }
+    }
+}
+
+/* The cache file is a magic followed by records, each an IconRecord and
+ * w * h pixels padded to 8 bytes. New records are appended unless the icon
+ * is stored already; once the file would outgrow ICON_CACHE_MAX it is
+ * started over and refilled by the icons stored from then on. Other dwm
+ * instances may have the file mapped, so it is never shrunk: a fresh one
+ * is renamed over it instead. */
+#define ICON_CACHE_MAGIC "dwmicon1"
+#define ICON_CACHE_MAX (4u << 20)
+
+typedef struct {
+    char class[64];
+    uint64_t hash;
+    uint32_t size, w, h, unused;
+} IconRecord;
+
+#define RECLEN(w, h) (sizeof(IconRecord) + (((size_t)(w) * (h) + 1) & ~(size_t)1) * 4)
+
+static struct {
+    char path[512];
+    int fd;
+    const unsigned char *map;
+    size_t len;  /* of map */
+    size_t size; /* of the file */
+    /* appended since map was made */
+    struct {
+        char class[64];
+        uint64_t hash;
+        unsigned int size;
+    } *stored;
+    size_t nstored;
+} cache = { "", -1, NULL, 0, 0, NULL, 0 };
+
+/* Drop every record, 0 if the file cannot be written any more. */
+static int
+cache_reset(void)
+{
+    char tmp[sizeof cache.path + 8];
+    int fd;
+
+    if(cache.map)
+        munmap((void *)cache.map, cache.len);
+    cache.map = NULL;
+    cache.len = 0;
+    cache.nstored = 0;
+    close(cache.fd);
+    cache.fd = -1;
+    snprintf(tmp, sizeof tmp, "%s.XXXXXX", cache.path);
+    if((fd = mkstemp(tmp)) < 0)
+        return 0;
+    if(write(fd, ICON_CACHE_MAGIC, 8) != 8
+       || fcntl(fd, F_SETFL, O_APPEND) < 0
+       || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0
+       || rename(tmp, cache.path) < 0) {
+        close(fd);
+        unlink(tmp);
+        return 0;
+    }
+    cache.fd = fd;
+    cache.size = 8;
+    return 1;
+}
+
+void
+icon_cache_open(void)
+{
+    char *path = cache.path;
+    const char *dir;
+    struct stat st;
+    char magic[8];
+
+    if((dir = getenv("XDG_CACHE_HOME")) && *dir)
+        snprintf(path, sizeof cache.path, "%s", dir);
+    else if((dir = getenv("HOME")))
+        snprintf(path, sizeof cache.path, "%s/.cache", dir);
+    else
+        return;
+    mkdir(path, 0700);
+    if(strlen(path) + sizeof "/dwm-icons" > sizeof cache.path)
+        return;
+    strcat(path, "/dwm-icons");
+    if((cache.fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600)) < 0)
+        return;
+    if(fstat(cache.fd, &st) < 0 || st.st_size < (off_t)sizeof magic
+       || st.st_size > ICON_CACHE_MAX
+       || pread(cache.fd, magic, sizeof magic, 0) != sizeof magic
+       || memcmp(magic, ICON_CACHE_MAGIC, sizeof magic)) {
+        cache_reset();
+        return;
+    }
+    cache.size = st.st_size;
+    cache.map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, cache.fd, 0);
+    if(cache.map == MAP_FAILED)
+        cache.map = NULL;
+    else
+        cache.len = st.st_size;
+}
+
+const uint32_t *
+icon_cache_find(const char *class, unsigned int size, uint64_t *hash,
+                unsigned int *w, unsigned int *h)
+{
+    const IconRecord *r, *found = NULL;
+    size_t off, n;
+
+    for(off = 8; off + sizeof *r <= cache.len; off += n) {
+        r = (const IconRecord *)(cache.map + off);
+        if(r->w > 16384 || r->h > 16384
+           || (n = RECLEN(r->w, r->h)) > cache.len - off)
+            break;
+        /* later records supersede earlier ones */
+        if(r->size == size && r->w <= size && r->h <= size && (!*hash || r->hash == *hash)
+           && !strncmp(r->class, class, sizeof r->class - 1))
+            found = r;
+    }
+    if(!found)
+        return NULL;
+    *hash = found->hash;
+    *w = found->w;
+    *h = found->h;
+    return (const uint32_t *)(found + 1);
+}
+
+void
+icon_cache_store(const char *class, unsigned int size, uint64_t hash,
+                 const uint32_t *px, unsigned int w, unsigned int h)
+{
+    IconRecord r = { { 0 }, hash, size, w, h, 0 };
+    unsigned int fw, fh;
+    uint64_t fhash = hash;
+    uint32_t pad = 0;
+    void *p;
+    size_t i;
+    struct iovec iov[3] = {
+        { &r, sizeof r },
+        { (void *)px, (size_t)w * h * sizeof *px },
+        { &pad, RECLEN(w, h) - sizeof r - (size_t)w * h * sizeof *px },
+    };
+
+    if(cache.fd < 0 || !hash || RECLEN(w, h) > ICON_CACHE_MAX - 8)
+        return;
+    strncpy(r.class, class, sizeof r.class - 1);
+    /* windows churning through the same few icons store each once */
+    for(i = 0; i < cache.nstored; i++)
+        if(cache.stored[i].hash == hash && cache.stored[i].size == size
+           && !strcmp(cache.stored[i].class, r.class))
+            return;
+    if(icon_cache_find(class, size, &fhash, &fw, &fh))
+        return;
+    if(cache.size + RECLEN(w, h) > ICON_CACHE_MAX && !cache_reset())
+        return;
+    /* a short append would misalign every later record, stop writing */
+    if(writev(cache.fd, iov, 3) != (ssize_t)RECLEN(w, h)) {
+        close(cache.fd);
+        cache.fd = -1;
+        return;
+    }
+    cache.size += RECLEN(w, h);
+    if(!(p = realloc(cache.stored, (cache.nstored + 1) * sizeof *cache.stored)))
+        return;
+    cache.stored = p;
+    memcpy(cache.stored[cache.nstored].class, r.class, sizeof r.class);
+    cache.stored[cache.nstored].hash = hash;
+    cache.stored[cache.nstored++].size = size;
+}
@@ -0,0 +1,20 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdint.h>
+
+/* Convert a _NET_WM_ICON image (one CARD32 pixel per unsigned long) of
+ * sw x sh to dw x dh premultiplied ARGB32 in dst, in a single pass:
+ * packing, premultiplying and box filtering are fused. */
+void icon_scale(uint32_t *dst, unsigned int dw, unsigned int dh,
+                const unsigned long *src, unsigned int sw, unsigned int sh);
+/* Name of the kernel icon_scale dispatches to on this CPU */
+const char *icon_kernel(void);
+
+/* On-disk cache of scaled icons, mapped at startup so a restart can upload
+ * icons without fetching and scaling _NET_WM_ICON again. */
+void icon_cache_open(void);
+/* Return the scaled pixels stored for class at size, NULL if none; hash 0
+ * matches the most recent entry for the class and sets *hash. */
+const uint32_t *icon_cache_find(const char *class, unsigned int size,
+                                uint64_t *hash, unsigned int *w, unsigned int *h);
+void icon_cache_store(const char *class, unsigned int size, uint64_t hash,
+                      const uint32_t *px, unsigned int w, unsigned int h);
@@ -0,0 +1,95 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Compare the icon pipeline (icon_scale) with the previous path: a scalar
+ * prealpha() pass followed by an Imlib2 cropped scaled copy. Run through
+ * `make bench`.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <Imlib2.h>
+
+#include "icon.h"
+
+#define ICONSIZE 16
+
+static uint32_t
+prealpha(uint32_t p)
+{
+    uint8_t a = p >> 24u;
+    uint32_t rb = (a * (p & 0xFF00FFu)) >> 8u;
+    uint32_t g = (a * (p & 0x00FF00u)) >> 8u;
+    return (rb & 0xFF00FFu) | (g & 0x00FF00u) | (a << 24u);
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+legacy(uint32_t *scratch, const unsigned long *src, unsigned int s)
+{
+    Imlib_Image origin, scaled;
+    unsigned int i;
+
+    for(i = 0; i < s * s; i++)
+        scratch[i] = prealpha(src[i]);
+    if(!(origin = imlib_create_image_using_data(s, s, (DATA32 *)scratch)))
+        return;
+    imlib_context_set_image(origin);
+    imlib_image_set_has_alpha(1);
+    scaled = imlib_create_cropped_scaled_image(0, 0, s, s, ICONSIZE, ICONSIZE);
+    imlib_free_image_and_decache();
+    if(scaled) {
+        imlib_context_set_image(scaled);
+        imlib_free_image_and_decache();
+    }
+}
+
+static void
+bench(unsigned int s, unsigned int iters)
+{
+    unsigned long *src = malloc(sizeof *src * s * s);
+    uint32_t *scratch = malloc(sizeof *scratch * s * s);
+    uint32_t dst[ICONSIZE * ICONSIZE];
+    double t, old, new;
+    unsigned int i;
+
+    if(!src || !scratch) {
+        fputs("iconbench: out of memory\n", stderr);
+        exit(1);
+    }
+    for(i = 0; i < s * s; i++)
+        src[i] = (unsigned long)rand() << 32 | (uint32_t)rand();
+
+    t = now();
+    for(i = 0; i < iters; i++)
+        legacy(scratch, src, s);
+    old = (now() - t) / iters;
+
+    t = now();
+    for(i = 0; i < iters; i++)
+        icon_scale(dst, ICONSIZE, ICONSIZE, src, s, s);
+    new = (now() - t) / iters;
+
+    printf("%ux%u -> %ux%u: prealpha+imlib2 %8.1f us, icon_scale %8.1f us (%.1fx)\n",
+           s, s, ICONSIZE, ICONSIZE, old * 1e6, new * 1e6, old / new);
+    free(src);
+    free(scratch);
+}
+
+int
+main(void)
+{
+    printf("icon kernel: %s\n", icon_kernel());
+    bench(256, 2000);
+    bench(512, 500);
+    return 0;
+}
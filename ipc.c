@@ -0,0 +1,388 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ipc.h"
+#include "util.h"
+
+/* The socket of the dwm on $DISPLAY: each display number gets its own, so
+ * a nested dwm does not take over the socket of the one around it. */
+int
+ipc_path(char *buf, size_t len)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    const char *dpy = getenv("DISPLAY");
+    const char *p;
+    int n, num = 0;
+
+    if(dpy && (p = strrchr(dpy, ':')))
+        num = atoi(p + 1);
+    if(dir && *dir)
+        n = snprintf(buf, len, "%s/dwm-ipc.%d", dir, num);
+    else
+        n = snprintf(buf, len, "/tmp/dwm-ipc-%u.%d", (unsigned)getuid(), num);
+    return n > 0 && (size_t)n < len
+           && (size_t)n < sizeof(((struct sockaddr_un *)0)->sun_path);
+}
+
+static void
+ipc_addr(struct sockaddr_un *sa, const char *path)
+{
+    memset(sa, 0, sizeof *sa);
+    sa->sun_family = AF_UNIX;
+    strncpy(sa->sun_path, path, sizeof sa->sun_path - 1);
+}
+
+int
+ipc_listen(const char *path)
+{
+    struct sockaddr_un sa;
+    mode_t mask;
+    int fd, r;
+
+    ipc_addr(&sa, path);
+    if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    unlink(path);
+    mask = umask(077); /* the socket drives the window manager, owner only */
+    r = bind(fd, (struct sockaddr *)&sa, sizeof sa);
+    umask(mask);
+    if(r < 0 || listen(fd, 8) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int
+ipc_connect(const char *path)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    ipc_addr(&sa, path);
+    if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    if(connect(fd, (struct sockaddr *)&sa, sizeof sa) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int
+xfer(int fd, char *p, size_t len, int out)
+{
+    ssize_t n;
+
+    while(len) {
+        n = out ? write(fd, p, len) : read(fd, p, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Blocking send and receive of one message, for clients */
+int
+ipc_send(int fd, const char *msg, size_t len)
+{
+    uint32_t n = len;
+
+    if(len > IPC_MAXMSG || xfer(fd, (char *)&n, sizeof n, 1) < 0)
+        return -1;
+    return xfer(fd, (char *)msg, len, 1);
+}
+
+char *
+ipc_recv(int fd, size_t *len)
+{
+    uint32_t n;
+    char *msg;
+
+    if(xfer(fd, (char *)&n, sizeof n, 0) < 0 || n > IPC_MAXMSG)
+        return NULL;
+    msg = ecalloc(n + 1, 1);
+    if(xfer(fd, msg, n, 0) < 0) {
+        free(msg);
+        return NULL;
+    }
+    *len = n;
+    return msg;
+}
+
+static void
+reserve(IpcBuf *b, size_t len)
+{
+    if(b->len + len + 1 > b->size) {
+        b->size = MAX(b->len + len + 1, b->size * 2);
+        if(!(b->data = realloc(b->data, b->size)))
+            die("realloc:");
+    }
+}
+
+void
+ipc_buf_add(IpcBuf *b, const char *data, size_t len)
+{
+    reserve(b, len);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+void
+ipc_buf_printf(IpcBuf *b, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if(n <= 0)
+        return;
+    reserve(b, n);
+    va_start(ap, fmt);
+    vsnprintf(b->data + b->len, n + 1, fmt, ap);
+    va_end(ap);
+    b->len += n;
+}
+
+/* Append s as a JSON string literal, null for NULL. */
+void
+ipc_buf_str(IpcBuf *b, const char *s)
+{
+    const char *p;
+
+    if(!s) {
+        ipc_buf_add(b, "null", 4);
+        return;
+    }
+    ipc_buf_add(b, "\"", 1);
+    for(p = s; *p; p++) {
+        if(*p == '"' || *p == '\\')
+            ipc_buf_printf(b, "\\%c", *p);
+        else if((unsigned char)*p < 0x20)
+            ipc_buf_printf(b, "\\u%04x", *p);
+        else
+            ipc_buf_add(b, p, 1);
+    }
+    ipc_buf_add(b, "\"", 1);
+}
+
+void
+ipc_buf_frame(IpcBuf *b, const char *msg, size_t len)
+{
+    uint32_t n = len;
+
+    ipc_buf_add(b, (char *)&n, sizeof n);
+    ipc_buf_add(b, msg, len);
+}
+
+void
+ipc_buf_drop(IpcBuf *b, size_t len)
+{
+    memmove(b->data, b->data + len, b->len - len);
+    b->len -= len;
+}
+
+void
+ipc_buf_free(IpcBuf *b)
+{
+    free(b->data);
+    memset(b, 0, sizeof *b);
+}
+
+static const char *
+ws(const char *p)
+{
+    while(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    return p;
+}
+
+/* Return the end of the value starting at v, NULL if it is malformed. */
+static const char *
+skip(const char *v)
+{
+    int depth = 0;
+
+    v = ws(v);
+    do {
+        switch(*v) {
+        case '\0':
+            return NULL;
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            if(--depth < 0)
+                return NULL;
+            break;
+        case '"':
+            for(v++; *v != '"'; v++)
+                if(!*v || (*v == '\\' && !*++v))
+                    return NULL;
+            break;
+        default:
+            if(!depth) {
+                while(*v && !strchr(",}] \t\r\n", *v))
+                    v++;
+                return v;
+            }
+        }
+        v++;
+    } while(depth);
+    return v;
+}
+
+const char *
+json_get(const char *obj, const char *key)
+{
+    const char *k, *v;
+    size_t klen = strlen(key);
+
+    if(!obj || *(obj = ws(obj)) != '{')
+        return NULL;
+    for(k = ws(obj + 1); *k == '"'; k = ws(v + 1)) {
+        if(!(v = skip(k)) || *(v = ws(v)) != ':')
+            return NULL;
+        if((size_t)(v - k) >= klen + 2 && !strncmp(k + 1, key, klen)
+           && k[klen + 1] == '"')
+            return ws(v + 1);
+        if(!(v = skip(v + 1)) || *(v = ws(v)) != ',')
+            return NULL;
+    }
+    return NULL;
+}
+
+const char *
+json_first(const char *arr)
+{
+    if(!arr || *(arr = ws(arr)) != '[' || *(arr = ws(arr + 1)) == ']')
+        return NULL;
+    return arr;
+}
+
+const char *
+json_next(const char *v)
+{
+    if(!v || !(v = skip(v)) || *(v = ws(v)) != ',')
+        return NULL;
+    return ws(v + 1);
+}
+
+/* Read the 4 hex digits of a \u escape, -1 if they are not. */
+static long
+json_hex4(const char *v)
+{
+    long cp = 0;
+    int i;
+
+    for(i = 0; i < 4; i++) {
+        cp <<= 4;
+        if(v[i] >= '0' && v[i] <= '9')
+            cp |= v[i] - '0';
+        else if(v[i] >= 'a' && v[i] <= 'f')
+            cp |= v[i] - 'a' + 10;
+        else if(v[i] >= 'A' && v[i] <= 'F')
+            cp |= v[i] - 'A' + 10;
+        else
+            return -1;
+    }
+    return cp;
+}
+
+/* Encode cp as UTF-8 into u, returns its length. */
+static size_t
+json_utf8(long cp, char *u)
+{
+    if(cp < 0x80) {
+        u[0] = cp;
+        return 1;
+    }
+    if(cp < 0x800) {
+        u[0] = 0xc0 | cp >> 6;
+        u[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    }
+    if(cp < 0x10000) {
+        u[0] = 0xe0 | cp >> 12;
+        u[1] = 0x80 | (cp >> 6 & 0x3f);
+        u[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    u[0] = 0xf0 | cp >> 18;
+    u[1] = 0x80 | (cp >> 12 & 0x3f);
+    u[2] = 0x80 | (cp >> 6 & 0x3f);
+    u[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+/* Copy the string v decoded to UTF-8 into out, cut off at len. */
+int
+json_str(const char *v, char *out, size_t len)
+{
+    const char *from = "\"\\/bfnrt", *to = "\"\\/\b\f\n\r\t", *p;
+    char u[4];
+    size_t i = 0, n, k;
+    long cp, lo;
+
+    if(!v || *v != '"' || !len)
+        return 0;
+    for(v++; *v && *v != '"'; v++) {
+        n = 1;
+        u[0] = *v;
+        if(*v == '\\' && *++v != 'u') {
+            if(!*v || !(p = strchr(from, *v)))
+                return 0;
+            u[0] = to[p - from];
+        } else if(*v == 'u' && u[0] == '\\') {
+            if((cp = json_hex4(v + 1)) < 0)
+                return 0;
+            v += 4;
+            /* a surrogate pair encodes one codepoint past the BMP */
+            if(cp >= 0xd800 && cp < 0xdc00 && v[1] == '\\' && v[2] == 'u'
+               && (lo = json_hex4(v + 3)) >= 0xdc00 && lo < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                v += 6;
+            } else if(cp >= 0xd800 && cp < 0xe000) {
+                cp = 0xfffd;
+            }
+            n = json_utf8(cp, u);
+        }
+        /* never split a character */
+        if(i + n < len)
+            for(k = 0; k < n; k++)
+                out[i++] = u[k];
+        else
+            len = i + 1;
+    }
+    out[i] = '\0';
+    return *v == '"';
+}
+
+int
+json_num(const char *v, double *out)
+{
+    char *end;
+
+    if(!v)
+        return 0;
+    *out = strtod(v, &end);
+    return end != v;
+}
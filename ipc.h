@@ -0,0 +1,32 @@
+/* See LICENSE file for copyright and license details. */
+
+/* Every message on the IPC socket is a 32 bit native endian byte count
+ * followed by that many bytes of JSON. */
+#define IPC_MAXMSG (1u << 20)
+
+typedef struct {
+	char *data;
+	size_t len, size;
+} IpcBuf;
+
+/* Socket */
+int ipc_path(char *buf, size_t len);
+int ipc_listen(const char *path);
+int ipc_connect(const char *path);
+int ipc_send(int fd, const char *msg, size_t len);
+char *ipc_recv(int fd, size_t *len);
+
+/* Output buffers and JSON writing */
+void ipc_buf_add(IpcBuf *b, const char *data, size_t len);
+void ipc_buf_printf(IpcBuf *b, const char *fmt, ...);
+void ipc_buf_str(IpcBuf *b, const char *s);
+void ipc_buf_frame(IpcBuf *b, const char *msg, size_t len);
+void ipc_buf_drop(IpcBuf *b, size_t len);
+void ipc_buf_free(IpcBuf *b);
+
+/* JSON reading: values are pointers into the message text, NULL when absent */
+const char *json_get(const char *obj, const char *key);
+const char *json_first(const char *arr);
+const char *json_next(const char *v);
+int json_str(const char *v, char *out, size_t len);
+int json_num(const char *v, double *out);
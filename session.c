@@ -0,0 +1,243 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "session.h"
+#include "util.h"
+
+/* The snapshot is SESSION_MAGIC, a record count and the records. The
+ * journal, path.journal, is a sequence of entries appended with a single
+ * write each; a torn last entry after a crash is ignored. A relative path
+ * is taken from $XDG_RUNTIME_DIR, else $XDG_STATE_HOME, else
+ * ~/.local/state, and gets the display number appended like the IPC
+ * socket, window ids of two X servers mean nothing to each other. Only
+ * regular files of our own are used. */
+#define SESSION_MAGIC "dwmsess1"
+
+enum { SessionPut, SessionDel };
+
+typedef struct {
+    uint32_t op;
+    uint32_t unused;
+    SessionRecord rec;
+} JournalEntry;
+
+static struct {
+    char path[256], journal[264];
+    int fd;
+    unsigned int pending;
+} sess = { .fd = -1 };
+
+static void
+paths(const char *path)
+{
+    const char *dir, *home = getenv("HOME"), *dpy = getenv("DISPLAY"), *p;
+    char state[256];
+    int num = 0;
+
+    if(dpy && (p = strrchr(dpy, ':')))
+        num = atoi(p + 1);
+    if(path[0] == '/')
+        snprintf(sess.path, sizeof sess.path, "%s", path);
+    else if((dir = getenv("XDG_RUNTIME_DIR")) && *dir)
+        snprintf(sess.path, sizeof sess.path, "%s/%s.%d", dir, path, num);
+    else if((dir = getenv("XDG_STATE_HOME")) && *dir)
+        snprintf(sess.path, sizeof sess.path, "%s/%s.%d", dir, path, num);
+    else {
+        home = home ? home : "";
+        snprintf(state, sizeof state, "%s/.local/state", home);
+        mkdir(state, 0700);
+        snprintf(sess.path, sizeof sess.path, "%s/.local/state/%s.%d", home,
+                 path, num);
+    }
+    snprintf(sess.journal, sizeof sess.journal, "%s.journal", sess.path);
+}
+
+/* Open path without following a symlink and refuse anything but a regular
+ * file of our own with a single link, so that nobody else can point our
+ * writes elsewhere. */
+static int
+openfile(const char *path, int flags)
+{
+    struct stat st;
+    int fd;
+
+    if((fd = open(path, flags | O_NOFOLLOW | O_CLOEXEC, 0600)) < 0)
+        return -1;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_uid != getuid()
+       || st.st_nlink != 1) {
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+    return fd;
+}
+
+static FILE *
+openread(const char *path)
+{
+    FILE *fp;
+    int fd;
+
+    if((fd = openfile(path, O_RDONLY)) < 0)
+        return NULL;
+    if(!(fp = fdopen(fd, "rb")))
+        close(fd);
+    return fp;
+}
+
+static size_t
+apply(SessionRecord **recs, size_t n, size_t *cap, const JournalEntry *e)
+{
+    size_t i;
+
+    for(i = 0; i < n && (*recs)[i].win != e->rec.win; i++)
+        ;
+    if(e->op == SessionDel) {
+        if(i < n)
+            (*recs)[i] = (*recs)[--n];
+        return n;
+    }
+    if(i == n) {
+        if(n == *cap) {
+            *cap = *cap ? *cap * 2 : 64;
+            if(!(*recs = realloc(*recs, *cap * sizeof **recs)))
+                die("realloc:");
+        }
+        n++;
+    }
+    (*recs)[i] = e->rec;
+    return n;
+}
+
+size_t
+session_load(const char *path, SessionRecord **recs)
+{
+    char magic[8];
+    uint32_t count;
+    size_t n = 0, cap = 0;
+    JournalEntry e;
+    FILE *fp;
+
+    *recs = NULL;
+    paths(path);
+    if((fp = openread(sess.path))) {
+        if(fread(magic, sizeof magic, 1, fp) == 1
+           && !memcmp(magic, SESSION_MAGIC, sizeof magic)
+           && fread(&count, sizeof count, 1, fp) == 1) {
+            e.op = SessionPut;
+            while(count-- && fread(&e.rec, sizeof e.rec, 1, fp) == 1)
+                n = apply(recs, n, &cap, &e);
+        }
+        fclose(fp);
+    }
+    if((fp = openread(sess.journal))) {
+        while(fread(&e, sizeof e, 1, fp) == 1)
+            if(e.op == SessionPut || e.op == SessionDel)
+                n = apply(recs, n, &cap, &e);
+        fclose(fp);
+    }
+    return n;
+}
+
+void
+session_open(const char *path)
+{
+    paths(path);
+    if(sess.fd < 0)
+        sess.fd = openfile(sess.journal, O_WRONLY | O_CREAT | O_APPEND);
+}
+
+static void
+append(uint32_t op, const SessionRecord *r)
+{
+    JournalEntry e = { op, 0, *r };
+
+    if(sess.fd < 0)
+        return;
+    if(write(sess.fd, &e, sizeof e) != sizeof e) {
+        /* a partial entry would shift every later one, stop journaling
+         * until the next snapshot */
+        close(sess.fd);
+        sess.fd = -1;
+        return;
+    }
+    sess.pending++;
+}
+
+void
+session_put(const SessionRecord *r)
+{
+    append(SessionPut, r);
+}
+
+void
+session_del(uint32_t win)
+{
+    SessionRecord r = { .win = win };
+
+    append(SessionDel, &r);
+}
+
+unsigned int
+session_pending(void)
+{
+    return sess.pending;
+}
+
+void
+session_snapshot(const SessionRecord *recs, size_t n)
+{
+    char tmp[272];
+    uint32_t count = n;
+    FILE *fp;
+    int fd;
+
+    if(!sess.path[0])
+        return;
+    /* a fresh temporary file, never one somebody left in our way */
+    snprintf(tmp, sizeof tmp, "%s.XXXXXX", sess.path);
+    if((fd = mkstemp(tmp)) < 0)
+        return;
+    if(!(fp = fdopen(fd, "wb"))) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    if(fwrite(SESSION_MAGIC, 8, 1, fp) != 1
+       || fwrite(&count, sizeof count, 1, fp) != 1
+       || (n && fwrite(recs, sizeof *recs, n, fp) != n)
+       || fflush(fp) || fsync(fileno(fp))) {
+        fclose(fp);
+        unlink(tmp);
+        return;
+    }
+    fclose(fp);
+    if(rename(tmp, sess.path) < 0) {
+        unlink(tmp);
+        return;
+    }
+    /* the snapshot now holds everything the journal did */
+    if(sess.fd >= 0)
+        close(sess.fd);
+    if((sess.fd = openfile(sess.journal, O_WRONLY | O_CREAT | O_APPEND)) >= 0
+       && ftruncate(sess.fd, 0) < 0) {
+        close(sess.fd);
+        sess.fd = -1;
+    }
+    sess.pending = 0;
+}
+
+void
+session_close(void)
+{
+    if(sess.fd >= 0)
+        close(sess.fd);
+    sess.fd = -1;
+}
@@ -0,0 +1,25 @@
+/* See LICENSE file for copyright and license details. */
+
+/* What dwm remembers about a managed window across restarts */
+typedef struct {
+	uint32_t win;
+	uint32_t tags;
+	uint32_t order;   /* position in its monitor's client list */
+	int32_t x, y, w, h;
+	int16_t mon, borderpx;
+	uint8_t isfloating, forcetile, iswarppointer, hasrulebw;
+	uint8_t iniposition, viewontag, hidden, unused;
+	char class[64], instance[64];
+} SessionRecord;
+
+/* Read the snapshot at path and replay its journal; *recs is malloc'd */
+size_t session_load(const char *path, SessionRecord **recs);
+/* Open the journal for appending, records since the last snapshot */
+void session_open(const char *path);
+void session_put(const SessionRecord *r);
+void session_del(uint32_t win);
+/* Number of journal entries since the last snapshot */
+unsigned int session_pending(void);
+/* Atomically replace the snapshot and empty the journal */
+void session_snapshot(const SessionRecord *recs, size_t n);
+void session_close(void);
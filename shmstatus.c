@@ -0,0 +1,158 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shmstatus.h"
+
+/* Open the status file with suffix, refusing anything but a file of type
+ * owned by us, private to us and linked once, so a planted symlink or
+ * hard link cannot make us write to someone's file. */
+int
+shmstatus_open(const char *suffix, int flags, mode_t type)
+{
+    char path[256];
+    struct stat st;
+    int fd;
+
+    if(!shmstatus_path(path, sizeof(path), suffix))
+        return -1;
+    if((fd = open(path, flags | O_NOFOLLOW | O_CLOEXEC, 0600)) < 0)
+        return -1;
+    if(fstat(fd, &st) < 0 || (st.st_mode & S_IFMT) != type
+       || st.st_uid != getuid() || (st.st_mode & 077) || st.st_nlink != 1) {
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+    return fd;
+}
+
+int
+shmstatus_path(char *buf, size_t len, const char *suffix)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    int n;
+
+    if(dir && *dir)
+        n = snprintf(buf, len, "%s/dwm-status%s", dir, suffix);
+    else
+        n = snprintf(buf, len, "/tmp/dwm-status-%u%s", (unsigned)getuid(),
+                     suffix);
+    return n > 0 && (size_t)n < len;
+}
+
+/* Map the status block, creating it if nobody did yet. */
+ShmStatus *
+shmstatus_map(void)
+{
+    ShmStatus *s;
+    int fd;
+
+    if((fd = shmstatus_open("", O_RDWR | O_CREAT, S_IFREG)) < 0)
+        return NULL;
+    if(ftruncate(fd, sizeof(ShmStatus)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    s = mmap(NULL, sizeof(ShmStatus), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+             0);
+    close(fd);
+    if(s == MAP_FAILED)
+        return NULL;
+    if(__atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != SHMSTATUS_MAGIC) {
+        memset(s->seg, 0, sizeof(s->seg));
+        __atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->magic, SHMSTATUS_MAGIC, __ATOMIC_RELEASE);
+    }
+    return s;
+}
+
+/* Producers serialize among each other by taking seq from even to odd.
+ * One that keeps it odd for SHMSTATUS_STALE_MS died half way through, its
+ * lock is taken over by moving seq on to the next odd value. */
+void
+shmstatus_publish(ShmStatus *s, unsigned int seg, const char *text)
+{
+    const struct timespec nap = { 0, 1000000 };
+    uint32_t seq, held, stale = 0;
+    unsigned int i, waited = 0;
+
+    if(!s || seg >= SHMSTATUS_SEGS)
+        return;
+    for(;;) {
+        seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+        held = seq + ((seq & 1) ? 2 : 1);
+        if(!(seq & 1) || (seq == stale && waited >= SHMSTATUS_STALE_MS)) {
+            if(__atomic_compare_exchange_n(&s->seq, &seq, held, 0,
+                                           __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                break;
+            continue;
+        }
+        if(seq != stale) {
+            stale = seq;
+            waited = 0;
+        }
+        nanosleep(&nap, NULL);
+        waited++;
+    }
+    if(held == seq + 2) /* whatever the dead producer wrote may be cut off */
+        for(i = 0; i < SHMSTATUS_SEGS; i++)
+            s->seg[i][SHMSTATUS_LEN - 1] = '\0';
+    strncpy(s->seg[seg], text, SHMSTATUS_LEN - 1);
+    s->seg[seg][SHMSTATUS_LEN - 1] = '\0';
+    /* fails only if we were too slow ourselves and got taken over */
+    __atomic_compare_exchange_n(&s->seq, &held, held + 1, 0, __ATOMIC_RELEASE,
+                                __ATOMIC_RELAXED);
+}
+
+/* Wake dwm up, a full fifo means it has a wakeup pending already. */
+void
+shmstatus_ring(void)
+{
+    int fd;
+
+    if((fd = shmstatus_open(".fifo", O_WRONLY | O_NONBLOCK, S_IFIFO)) < 0)
+        return;
+    if(write(fd, "", 1) < 0 && errno != EAGAIN)
+        perror("dwm-status: write");
+    close(fd);
+}
+
+/* Tell the CPU we are spinning, so a producer on a sibling thread gets on. */
+static void
+relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* Copy a consistent snapshot, returns 0 if producers kept it busy or one
+ * died holding seq; the caller keeps what it had and tries again later. */
+int
+shmstatus_snapshot(ShmStatus *s, char seg[SHMSTATUS_SEGS][SHMSTATUS_LEN])
+{
+    uint32_t before, after;
+    int tries;
+
+    for(tries = 0; tries < 64; tries++, relax()) {
+        before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if(before & 1)
+            continue;
+        memcpy(seg, s->seg, sizeof(s->seg));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+        if(before == after)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Status block shared with external producers. It lives in a file under
+ * $XDG_RUNTIME_DIR and is guarded by a seqlock: a writer makes seq odd while
+ * it updates a segment, readers retry until they saw the same even seq before
+ * and after copying. After publishing, producers write a byte to the doorbell
+ * fifo next to it so dwm wakes up. Both are only used when they are ours,
+ * private and not linked from anywhere else, the fallback below /tmp is
+ * open to anyone. */
+#define SHMSTATUS_MAGIC 0x73776d64U /* "dwms" */
+#define SHMSTATUS_SEGS  8
+#define SHMSTATUS_LEN   64
+#define SHMSTATUS_STALE_MS 1000 /* a producer holding seq longer died */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t seq;
+	char seg[SHMSTATUS_SEGS][SHMSTATUS_LEN];
+} ShmStatus;
+
+int shmstatus_open(const char *suffix, int flags, mode_t type);
+int shmstatus_path(char *buf, size_t len, const char *suffix);
+ShmStatus *shmstatus_map(void);
+void shmstatus_publish(ShmStatus *s, unsigned int seg, const char *text);
+void shmstatus_ring(void);
+int shmstatus_snapshot(ShmStatus *s, char seg[SHMSTATUS_SEGS][SHMSTATUS_LEN]);
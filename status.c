@@ -0,0 +1,131 @@
+/* See LICENSE file for copyright and license details. */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "status.h"
+
+static int
+pscanf(const char *path, const char *fmt, ...)
+{
+    FILE *fp;
+    va_list ap;
+    int n;
+
+    if(!(fp = fopen(path, "r")))
+        return -1;
+    va_start(ap, fmt);
+    n = vfscanf(fp, fmt, ap);
+    va_end(ap);
+    fclose(fp);
+
+    return (n == EOF) ? -1 : n;
+}
+
+static unsigned long long
+nowns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+fmthuman(char *buf, size_t len, double n)
+{
+    const char prefix[] = { 'B', 'K', 'M', 'G', 'T' };
+    size_t i;
+
+    for(i = 0; i < sizeof(prefix) - 1 && n >= 1024; i++)
+        n /= 1024;
+    return snprintf(buf, len, "%.1f%c", n, prefix[i]) > 0;
+}
+
+int
+status_battery(char *buf, size_t len, const char *bat, StatusState *st)
+{
+    char path[128], state[16];
+    int perc;
+
+    snprintf(path, sizeof(path), "/sys/class/power_supply/%s/capacity", bat);
+    if(pscanf(path, "%d", &perc) != 1)
+        return 0;
+    snprintf(path, sizeof(path), "/sys/class/power_supply/%s/status", bat);
+    if(pscanf(path, "%15s", state) != 1)
+        state[0] = '\0';
+    return snprintf(buf, len, "%d%%%s", perc,
+                    !strcmp(state, "Charging") ? "+" : "") > 0;
+}
+
+int
+status_clock(char *buf, size_t len, const char *fmt, StatusState *st)
+{
+    time_t t = time(NULL);
+    struct tm tm;
+
+    if(!localtime_r(&t, &tm))
+        return 0;
+    return strftime(buf, len, fmt, &tm) > 0;
+}
+
+int
+status_cpu(char *buf, size_t len, const char *unused, StatusState *st)
+{
+    unsigned long long v[8], total, idle;
+    int perc = 0;
+
+    if(pscanf("/proc/stat", "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+              &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8)
+        return 0;
+    total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+    idle = v[3] + v[4];
+    if(st->a && total > st->a)
+        perc = 100 * ((total - st->a) - (idle - st->b)) / (total - st->a);
+    st->a = total;
+    st->b = idle;
+    return snprintf(buf, len, "%d%%", perc) > 0;
+}
+
+int
+status_mem(char *buf, size_t len, const char *unused, StatusState *st)
+{
+    unsigned long long total, avail;
+
+    if(pscanf("/proc/meminfo", "MemTotal: %llu kB\nMemFree: %*u kB\n"
+              "MemAvailable: %llu kB", &total, &avail) != 2 || !total)
+        return 0;
+    return snprintf(buf, len, "%d%%", (int)(100 * (total - avail) / total)) > 0;
+}
+
+static int
+netrate(char *buf, size_t len, const char *iface, const char *dir,
+        StatusState *st)
+{
+    char path[128];
+    unsigned long long bytes, now = nowns();
+    double rate = 0;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/%s_bytes",
+             iface, dir);
+    if(pscanf(path, "%llu", &bytes) != 1)
+        return 0;
+    if(st->b && now > st->b && bytes >= st->a)
+        rate = (bytes - st->a) * 1e9 / (now - st->b);
+    st->a = bytes;
+    st->b = now;
+    return fmthuman(buf, len, rate);
+}
+
+int
+status_netrx(char *buf, size_t len, const char *iface, StatusState *st)
+{
+    return netrate(buf, len, iface, "rx", st);
+}
+
+int
+status_nettx(char *buf, size_t len, const char *iface, StatusState *st)
+{
+    return netrate(buf, len, iface, "tx", st);
+}
@@ -0,0 +1,21 @@
+/* See LICENSE file for copyright and license details. */
+
+/* per-module memory for rate based modules (cpu, network) */
+typedef struct {
+	unsigned long long a, b;
+} StatusState;
+
+typedef struct {
+	int (*func)(char *buf, size_t len, const char *arg, StatusState *st);
+	const char *fmt;          /* printf format applied to the module value */
+	const char *arg;
+	unsigned int interval;    /* ms */
+} StatusModule;
+
+/* Status modules, all return 0 if no value could be read */
+int status_battery(char *buf, size_t len, const char *bat, StatusState *st);
+int status_clock(char *buf, size_t len, const char *fmt, StatusState *st);
+int status_cpu(char *buf, size_t len, const char *unused, StatusState *st);
+int status_mem(char *buf, size_t len, const char *unused, StatusState *st);
+int status_netrx(char *buf, size_t len, const char *iface, StatusState *st);
+int status_nettx(char *buf, size_t len, const char *iface, StatusState *st);